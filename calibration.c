@@ -3,6 +3,23 @@
  * @brief Functions to calibrate colours.
  */
 
+/** Bits kept from each BGR channel when indexing the skin lookup table. */
+#define LUT_BITS 6
+/** Number of entries in the skin lookup table, one per quantised colour. */
+#define LUT_SIZE (1 << (3 * LUT_BITS))
+
+/**
+ * @brief How skin pixels are classified by get_arm_bgr.
+ */
+typedef enum {
+  /** Convert every pixel to HSV and compare it against the calibration. */
+  threshold_exact,
+  /** Look up each quantised BGR colour in the calibration's table. */
+  threshold_lut,
+  /** Use the exact result, but count how often the table disagrees with it. */
+  threshold_compare,
+} threshold_mode_t;
+
 /**
  * @brief A struct to hold the HSV values of the calibrated skin colour.
  */
@@ -25,8 +42,41 @@ typedef struct {
   CvScalar upper;
   /** Vector of the min HSV values so they can be rendered. */
   CvScalar lower;
+  /** How skin pixels are classified. */
+  threshold_mode_t mode;
+  /** 255 for each quantised BGR colour that is skin, 0 otherwise. */
+  unsigned char *lut;
+  /** Pixels where the table and the exact test disagreed, in compare mode. */
+  long lut_mismatches;
+  /** Pixels checked in compare mode. */
+  long lut_pixels;
 } calibration_t;
 
+void build_skin_lut(calibration_t *c);
+
+/**
+ * @brief Initialises the calibration_t struct.
+ * @returns A pointer to the new, not yet calibrated, calibration_t struct.
+ */
+calibration_t *init_calibration(void) {
+  calibration_t *c = (calibration_t *) malloc(sizeof(calibration_t));
+  c->done = false;
+  c->mode = threshold_exact;
+  c->lut = (unsigned char *) malloc(LUT_SIZE);
+  c->lut_mismatches = 0;
+  c->lut_pixels = 0;
+  return c;
+}
+
+/**
+ * @brief Frees a calibration_t struct and its lookup table.
+ * @param c The calibration struct to free.
+ */
+void free_calibration(calibration_t *c) {
+  free(c->lut);
+  free(c);
+}
+
 /**
  * @brief Given a coordinate and a box, determines whether it is in the box.
  * @param x The x coordinate.
@@ -44,38 +94,60 @@ bool in_box(int x, int y, int box_x, int box_y, int width, int height) {
     && y < box_y + height);
 }
 
+/**
+ * @brief The arguments of overlay_band, see overlay_frame.
+ */
+typedef struct {
+  cv::Mat frame;
+  int reg_x;
+  int reg_y;
+  int reg_height;
+  int reg_width;
+} overlay_args_t;
+
+/**
+ * @brief Darkens a band of rows of a frame outside the centre box.
+ */
+void overlay_band(int start, int end, int band, void *arg) {
+  overlay_args_t *a = (overlay_args_t *) arg;
+  int channels = a->frame.channels();
+  for (int y = start; y < end; y++) {
+    unsigned char *row = a->frame.ptr<unsigned char>(y);
+    for (int x = 0; x < a->frame.cols; x++) {
+      if (!in_box(x, y, a->reg_x, a->reg_y, a->reg_width, a->reg_height)) {
+        for (int w = 0; w < channels; w++) {
+          row[x * channels + w] /= 4;
+        }
+      }
+    }
+  }
+}
+
 /**
  * @brief Given a frame, applies a darkened border around it.
  * User will place their hand inside the undarkened centre box to calibrate
- * their skin colour.
- * @param frame The IplImage frame.
+ * their skin colour. The rows are split into bands on the thread pool.
+ * @param frame The frame, darkened in place.
  * @param reg_x The centre box x coordinate.
  * @param reg_y The centre box y coordinate.
  * @param reg_height The centre box height.
  * @param reg_width The centre box width.
  */
-void overlay_frame(IplImage *frame, int reg_x, int reg_y, int reg_height, int reg_width) {
-  for (int y = 0; y < frame->height; y++) {
-    for (int x = 0; x < frame->width; x++) {
-      if (!in_box(x, y, reg_x, reg_y, reg_width, reg_height)) {
-        for (int w = 0; w < frame->nChannels; w++) {
-          frame->imageData[y * frame->widthStep + x * frame->nChannels + w] = (unsigned char) (frame->imageData[y * frame->widthStep + x * frame->nChannels + w]) / 4;
-        }
-      }
-    }
-  }
+void overlay_frame(cv::Mat &frame, int reg_x, int reg_y, int reg_height, int reg_width) {
+  overlay_args_t a = {frame, reg_x, reg_y, reg_height, reg_width};
+  run_bands(frame.rows, band_count(frame.rows, MIN_BAND_ROWS), overlay_band, &a);
 }
 
 /**
  * @brief Calibrates according to the skin colour in centre box in the frame.
- * @param frame The IplImage frame.
+ * @param frame The HSV frame.
  * @param c The calibration struct to place the skin colour values in.
  * @param reg_x The centre box x coordinate.
  * @param reg_y The centre box y coordinate.
  * @param reg_height The centre box height.
  * @param reg_width The centre box width.
  */
-void final_calibration(IplImage *frame, calibration_t *c, int reg_x, int reg_y, int reg_height, int reg_width) {
+void final_calibration(const cv::Mat &frame, calibration_t *c, int reg_x, int reg_y, int reg_height, int reg_width) {
   int size = 0;
   for (int y = reg_y - reg_height; y < reg_y + reg_height; y++) {
     for (int x = reg_x - reg_width; x < reg_x + reg_width; x++) {
@@ -88,11 +160,13 @@ void final_calibration(IplImage *frame, calibration_t *c, int reg_x, int reg_y,
   uchar_array_t *v_arr = init_arr(size);
   int i = 0;
 
+  int channels = frame.channels();
   for (int y = reg_y - reg_height; y < reg_y + reg_height; y++) {
+    const unsigned char *row = frame.ptr<unsigned char>(y);
     for (int x = reg_x - reg_width; x < reg_x + reg_width; x++) {
-      h_arr->array[i] = frame->imageData[y * frame->widthStep + x * frame->nChannels];
-      s_arr->array[i] = frame->imageData[y * frame->widthStep + x * frame->nChannels + 1];
-      v_arr->array[i] = frame->imageData[y * frame->widthStep + x * frame->nChannels + 2];
+      h_arr->array[i] = row[x * channels];
+      s_arr->array[i] = row[x * channels + 1];
+      v_arr->array[i] = row[x * channels + 2];
       i++;
     }
   }
@@ -115,6 +189,7 @@ void final_calibration(IplImage *frame, calibration_t *c, int reg_x, int reg_y,
   c->v_max *= 1 + range;
   c->lower = cvScalar(c->h_min, c->s_min, c->v_min);
   c->upper = cvScalar(c->h_max, c->s_max, c->v_max);
+  build_skin_lut(c);
 
   printf("h_max: %f\n", (float) (c->h_max));
   printf("h_min: %f\n", (float) (c->h_min));
@@ -136,15 +211,16 @@ void generic_calibration(calibration_t *c) {
   c->v_max = 255;
   c->v_min = 60;
   c->done = true;
+  build_skin_lut(c);
 }
 
 /**
  * @brief Displays a calibration window for the user to calibrate their skin.
- * @param capture The CvCapture video stream.
+ * @param source Where to read the frames from.
  * @param calibration The calibration struct to place the skin colour values in.
  */
-void calibrate(CvCapture *capture, calibration_t *calibration) {
-  IplImage *frame = 0;
+void calibrate(frame_source_t *source, calibration_t *calibration) {
+  cv::Mat view;
   calibration->done = false;
 
   int reg_x = 0;
@@ -154,26 +230,33 @@ void calibrate(CvCapture *capture, calibration_t *calibration) {
   int timer = 0;
 
   while ((cvWaitKey(10) != 'q' || calibration->done) && timer < 90) {
-    frame = cvQueryFrame(capture);
+    cv::Mat frame = read_frame(source);
 
-    if (frame) {
+    if (!frame.empty()) {
       if (reg_x == 0) {
-        reg_x = frame->width / 2;
-        reg_y = frame->height / 2;
-        reg_height = frame->height / 20;
-        reg_width = frame->width / 20;
+        reg_x = frame.cols / 2;
+        reg_y = frame.rows / 2;
+        reg_height = frame.rows / 20;
+        reg_width = frame.cols / 20;
       }
 
-      overlay_frame(frame,reg_x, reg_y, reg_height, reg_width);
-      cvFlip(frame, frame, 1);
-      cvShowImage("Calibrate", frame);
+      // Drawn on a copy, as recorded frames may be shared with the source.
+      frame.copyTo(view);
+      overlay_frame(view, reg_x, reg_y, reg_height, reg_width);
+      cv::flip(view, view, 1);
+      cv::imshow("Calibrate", view);
+      // Take the colour from the frame as it was, not the mirrored overlay.
+      frame.copyTo(view);
     }
 
     timer++;
   }
-  cvCvtColor(frame, frame, CV_BGR2HSV);
+  if (view.empty()) {
+    fprintf(stderr, "No frames to calibrate on\n");
+    exit(EXIT_FAILURE);
+  }
+  cv::cvtColor(view, view, CV_BGR2HSV);
   printf("%i %i %i %i\n", reg_x, reg_y, reg_height, reg_width);
-  final_calibration(frame, calibration, reg_x, reg_y, reg_height, reg_width);
-  cvCvtColor(frame, frame, CV_HSV2BGR);
+  final_calibration(view, calibration, reg_x, reg_y, reg_height, reg_width);
   cvDestroyWindow("Calibrate");
 }
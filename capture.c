@@ -0,0 +1,238 @@
+/**
+ * @file capture.c
+ * @brief A thread that reads a frame source and hands the newest frame to the vision thread.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * @brief Number of frame buffers, one being written, one waiting to be read and
+ * one being used by the reader.
+ */
+#define CAPTURE_SLOTS 3
+/** Set in the mailbox when the slot in it has not been taken yet. */
+#define MAILBOX_FRESH 4
+/** Seconds to wait for a source's first frame before giving up on it. */
+#define FIRST_FRAME_TIMEOUT 10
+
+/**
+ * @brief A frame and when it was grabbed.
+ */
+typedef struct {
+  /** A copy of the frame in a pooled buffer, owned by the capture thread. */
+  cv::Mat image;
+  /** Number of frames grabbed before this one. */
+  uint64_t sequence;
+  /** CLOCK_MONOTONIC time the frame was grabbed, in seconds. */
+  double timestamp;
+} captured_frame_t;
+
+/**
+ * @brief A struct that holds the capture thread and its frame buffers.
+ * The slots are passed around by index without locks: the capture thread owns
+ * back, the reader owns front, and the mailbox holds the third slot plus a
+ * fresh flag. Each side swaps its slot with the mailbox atomically.
+ */
+typedef struct {
+  /** Where the frames come from. */
+  frame_source_t *source;
+  /** The thread grabbing frames. */
+  pthread_t thread;
+  /** The frame buffers. */
+  captured_frame_t slots[CAPTURE_SLOTS];
+  /** The slot the capture thread is writing to. */
+  int back;
+  /** The slot the reader last took. */
+  int front;
+  /** The newest complete slot, or'd with MAILBOX_FRESH until it is taken. */
+  int mailbox;
+  /** Frames that were replaced by a newer one before being read. */
+  long dropped;
+  /** Frames grabbed so far. */
+  uint64_t grabbed;
+  /** Set to make the capture thread exit. */
+  int stopping;
+  /** An eventfd signalled whenever a frame is put in the mailbox. */
+  int ready_fd;
+  /** True to wait for each frame to be taken rather than drop it, when replaying as fast as possible. */
+  bool lossless;
+  /** An eventfd signalled whenever a frame is taken, in the lossless mode. */
+  int taken_fd;
+  /** Set once the source has no frames left and the last one is in the mailbox. */
+  int finished;
+} capture_thread_t;
+
+/**
+ * @brief Puts a frame in a slot, which must already be the same shape.
+ * @param t The capture thread.
+ * @param slot The slot to fill.
+ * @param frame The frame from the source.
+ * @param sequence The frame's sequence number.
+ */
+void fill_slot(capture_thread_t *t, captured_frame_t *slot, const cv::Mat &frame, uint64_t sequence) {
+  if (frame.rows != slot->image.rows || frame.cols != slot->image.cols || frame.type() != slot->image.type()) {
+    fprintf(stderr, "Frames must all be the same size\n");
+    exit(EXIT_FAILURE);
+  }
+  if (t->source->stable) {
+    // Frames that outlive the read, such as a mapped raw video, are not copied at all.
+    slot->image = frame;
+  } else {
+    // The only copy a frame gets, out of the source's buffer into a pooled one.
+    frame.copyTo(slot->image);
+  }
+  slot->sequence = sequence;
+  slot->timestamp = monotonic_seconds();
+}
+
+/**
+ * @brief The loop the capture thread runs, grabbing frames as fast as the source gives them.
+ * @param data The capture_thread_t struct.
+ * @returns NULL once stopped, or once the source has run out.
+ */
+void *capture_loop(void *data) {
+  capture_thread_t *t = (capture_thread_t *) data;
+
+  while (!__atomic_load_n(&t->stopping, __ATOMIC_ACQUIRE)) {
+    cv::Mat frame = read_frame(t->source);
+    if (frame.empty()) {
+      if (t->source->finished) {
+        break;
+      }
+      usleep(1000);
+      continue;
+    }
+    fill_slot(t, &t->slots[t->back], frame, t->grabbed++);
+
+    // Wait for the reader to take the last frame, rather than replace it.
+    while (t->lossless && (__atomic_load_n(&t->mailbox, __ATOMIC_ACQUIRE) & MAILBOX_FRESH)
+           && !__atomic_load_n(&t->stopping, __ATOMIC_ACQUIRE)) {
+      wait_notifier(t->taken_fd);
+    }
+
+    // Publish the slot, and take back whichever one was in the mailbox.
+    int old = __atomic_exchange_n(&t->mailbox, t->back | MAILBOX_FRESH, __ATOMIC_ACQ_REL);
+    if (old & MAILBOX_FRESH) {
+      __atomic_add_fetch(&t->dropped, 1, __ATOMIC_RELAXED);
+    }
+    t->back = old & ~MAILBOX_FRESH;
+    notify(t->ready_fd);
+  }
+
+  __atomic_store_n(&t->finished, 1, __ATOMIC_RELEASE);
+  notify(t->ready_fd);
+  return NULL;
+}
+
+/**
+ * @brief Starts a thread reading frames from a source.
+ * Waits for the first frame, so the buffers can all be taken from the frame
+ * pool at its size, and puts it in the mailbox. Exits if the source finishes
+ * or gives nothing for FIRST_FRAME_TIMEOUT seconds. Stable sources need no
+ * buffers, as their frames are passed on where they are. Nothing else may read from
+ * the source until stop_capture is called. Recorded sources read as fast as
+ * possible are captured losslessly, so every frame reaches the reader.
+ * @param source Where to read the frames from.
+ * @returns A pointer to the new capture_thread_t struct.
+ */
+capture_thread_t *start_capture(frame_source_t *source) {
+  capture_thread_t *t = new capture_thread_t();
+  t->source = source;
+
+  cv::Mat frame;
+  double deadline = monotonic_seconds() + FIRST_FRAME_TIMEOUT;
+  while ((frame = read_frame(source)).empty()) {
+    if (source->finished) {
+      fprintf(stderr, "No frames to read\n");
+      exit(EXIT_FAILURE);
+    }
+    if (monotonic_seconds() > deadline) {
+      fprintf(stderr, "No frame from the source after %d seconds\n", FIRST_FRAME_TIMEOUT);
+      exit(EXIT_FAILURE);
+    }
+    usleep(1000);
+  }
+  for (int i = 0; i < CAPTURE_SLOTS; i++) {
+    t->slots[i].image = source->stable ? frame : acquire_mat(frame.rows, frame.cols, frame.type());
+  }
+  fill_slot(t, &t->slots[2], frame, 0);
+  t->back = 0;
+  t->front = 1;
+  t->mailbox = 2 | MAILBOX_FRESH;
+  t->dropped = 0;
+  t->grabbed = 1;
+  t->stopping = 0;
+  t->ready_fd = make_notifier();
+  t->lossless = !source->realtime;
+  t->taken_fd = make_notifier();
+  t->finished = 0;
+
+  if (pthread_create(&t->thread, NULL, capture_loop, t)) {
+    perror("Unable to start capture thread");
+    exit(EXIT_FAILURE);
+  }
+  return t;
+}
+
+/**
+ * @brief Takes the newest frame from the capture thread, without waiting.
+ * @param t The capture thread.
+ * @returns The newest frame, or NULL if there has not been a new one since the
+ *          last call. It stays valid and unchanged until the next call.
+ */
+captured_frame_t *latest_frame(capture_thread_t *t) {
+  if (!(__atomic_load_n(&t->mailbox, __ATOMIC_ACQUIRE) & MAILBOX_FRESH)) {
+    return NULL;
+  }
+  t->front = __atomic_exchange_n(&t->mailbox, t->front, __ATOMIC_ACQ_REL) & ~MAILBOX_FRESH;
+  if (t->lossless) {
+    notify(t->taken_fd);
+  }
+  return &t->slots[t->front];
+}
+
+/**
+ * @brief Sleeps until the capture thread has a new frame, or until woken with notify.
+ * @param t The capture thread.
+ */
+void wait_for_frame(capture_thread_t *t) {
+  wait_notifier(t->ready_fd);
+}
+
+/**
+ * @brief Checks whether the source has run out of frames.
+ * Once it has, every frame it gave has already been put in the mailbox.
+ * @param t The capture thread.
+ * @returns True iff no more frames will come.
+ */
+bool capture_finished(capture_thread_t *t) {
+  return __atomic_load_n(&t->finished, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Gets how many frames were dropped because a newer one came first.
+ * @param t The capture thread.
+ * @returns The number of dropped frames.
+ */
+long dropped_frames(capture_thread_t *t) {
+  return __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Stops the capture thread and frees its buffers.
+ * The source itself is left open.
+ * @param t The capture thread.
+ */
+void stop_capture(capture_thread_t *t) {
+  __atomic_store_n(&t->stopping, 1, __ATOMIC_RELEASE);
+  // Wake the thread if it is waiting for a frame to be taken.
+  notify(t->taken_fd);
+  pthread_join(t->thread, NULL);
+  for (int i = 0; i < CAPTURE_SLOTS; i++) {
+    release_mat(&t->slots[i].image);
+  }
+  close(t->ready_fd);
+  close(t->taken_fd);
+  delete t;
+}
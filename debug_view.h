@@ -0,0 +1,23 @@
+/**
+ * @file debug_view.h
+ * @brief Where the debug windows are drawn, shared by the vision thread and the options.
+ */
+#ifndef debug_view_h
+#define debug_view_h
+
+/** Most times a second the debug windows are updated in the async mode. */
+#define DEBUG_VIEW_HZ 10
+
+/**
+ * @brief Where, if anywhere, the debug windows are drawn.
+ */
+typedef enum {
+  /** No windows, and no HighGUI calls at all. */
+  debug_view_none,
+  /** Every frame is copied, and the game loop shows it when it wakes for the hands. */
+  debug_view_inline,
+  /** A thread of its own shows snapshots at most DEBUG_VIEW_HZ times a second. */
+  debug_view_async,
+} debug_view_mode_t;
+
+#endif
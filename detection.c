@@ -4,6 +4,32 @@
  */
 
 #define ITERATIONS 10
+/*
+ * The distances below are in pixels of the frames they were tuned on, and are
+ * multiplied by hands_t.scale for frames that are processed smaller.
+ */
+/** Distance from a hand point to the edge of the square of pixels pulling on it. */
+#define FORCE_RADIUS 100
+/** Distance from a hand point to the edge of its centroid window. */
+#define CENTROID_RADIUS 150
+/** The most times a centroid window is moved per frame. */
+#define CENTROID_ITERATIONS 5
+/** The most pyramid levels detect_hands can use, the smallest is 1/8 size. */
+#define MAX_PYRAMID_LEVELS 4
+/** Number of final iterations that are always run at full resolution. */
+#define FINE_ITERATIONS 3
+
+/**
+ * @brief How the forces on the hand points are found.
+ */
+typedef enum {
+  /** Sum the pull of every pixel around each point, on every iteration. */
+  detect_iterative,
+  /** Look the forces up in a force field computed once per frame. */
+  detect_field,
+  /** Move each point to the centre of the skin around it, like mean-shift. */
+  detect_centroid,
+} detection_mode_t;
 
 /**
  * @brief A struct that holds information about the positions of hands.
@@ -14,8 +40,91 @@ typedef struct {
   int right_x;
   int right_y;
   bool is_null;
+  /** How the forces on the points are found. */
+  detection_mode_t mode;
+  /** Number of mask resolutions the iterative mode uses, 1 for only full. */
+  int pyramid_levels;
+  /** Size of the frames given to detect_hands relative to the frames the constants were tuned on. */
+  double scale;
 } hands_t;
 
+/**
+ * @brief The force every pixel of a frame would feel, before scaling.
+ * The force on a point is the correlation of the frame with a fixed kernel,
+ * so it is computed for all pixels at once with the DFT.
+ */
+typedef struct {
+  /** Width of the frame the field was computed for. */
+  int width;
+  /** Height of the frame the field was computed for. */
+  int height;
+  /** The scale the kernels were made for. */
+  double unit;
+  /** The frame as floats, zero padded to the DFT size. */
+  cv::Mat padded;
+  /** Spectrum of the padded frame. */
+  cv::Mat spectrum;
+  /** Spectrum of the x force kernel. */
+  cv::Mat kernel_x;
+  /** Spectrum of the y force kernel. */
+  cv::Mat kernel_y;
+  /** Product of the frame and a kernel spectrum. */
+  cv::Mat product;
+  /** The x force on each pixel. */
+  cv::Mat x;
+  /** The y force on each pixel. */
+  cv::Mat y;
+} force_field_t;
+
+/**
+ * @brief Summed-area tables of a frame's pixels and their moments.
+ * Entry (x, y) of each table is the total over all pixels above and to the
+ * left of (x, y), so the total over any rectangle takes four lookups.
+ */
+typedef struct {
+  /** Width of the tables, one more than the frame width. */
+  int width;
+  /** Height of the tables, one more than the frame height. */
+  int height;
+  /** Sum of the pixel values. */
+  int64_t *mass;
+  /** Sum of the pixel values times their x coordinates. */
+  int64_t *moment_x;
+  /** Sum of the pixel values times their y coordinates. */
+  int64_t *moment_y;
+} mass_tables_t;
+
+/** Fixed point precision of the distance weights, the largest weight is 1. */
+#define FORCE_WEIGHT_SHIFT 15
+
+/**
+ * @brief The distance weights of every offset a point is pulled from.
+ */
+typedef struct {
+  /** The scale of the full resolution frame the weights were made for. */
+  double unit;
+  /** Distance from the point to the edge of the square, in this level's pixels. */
+  int radius;
+  /** The (2 * radius) squared weights, row major and 64 byte aligned. */
+  uint16_t *weights;
+} force_kernel_t;
+
+/**
+ * @brief A struct that holds the tables detect_hands keeps from frame to frame.
+ * Each vision pipeline has its own, so pipelines working at different frame
+ * sizes never rebuild each other's tables.
+ */
+typedef struct {
+  /** The force field of the latest frame, used by detect_field. */
+  force_field_t field;
+  /** The summed-area tables of the latest frame, used by detect_centroid. */
+  mass_tables_t tables;
+  /** The distance weights of each pyramid level, built when first needed. */
+  force_kernel_t kernels[MAX_PYRAMID_LEVELS];
+  /** The halved copies of the latest mask, level 0 is the mask itself. */
+  cv::Mat pyramid[MAX_PYRAMID_LEVELS];
+} detection_t;
+
 /**
  * @brief Initialises the hands_t struct.
  * @returns A pointer to the new hands_t struct.
@@ -23,9 +132,39 @@ typedef struct {
 hands_t *init_hands(void) {
   hands_t *h = (hands_t *) malloc(sizeof(hands_t));
   h->is_null = true;
+  h->mode = detect_iterative;
+  h->pyramid_levels = 1;
+  h->scale = 1;
   return h;
 }
 
+/**
+ * @brief Initialises the detection_t struct.
+ * Its tables are built by detect_hands on the first frame.
+ * @returns A pointer to the new detection_t struct.
+ */
+detection_t *init_detection(void) {
+  return new detection_t();
+}
+
+/**
+ * @brief Frees the detection_t struct and its tables.
+ * @param d The detection_t struct to free.
+ */
+void free_detection(detection_t *d) {
+  for (int level = 0; level < MAX_PYRAMID_LEVELS; level++) {
+    free(d->kernels[level].weights);
+  }
+  // Level 0 is the caller's mask, only the levels built from it are the pyramid's.
+  for (int level = 1; level < MAX_PYRAMID_LEVELS; level++) {
+    release_mat(&d->pyramid[level]);
+  }
+  free(d->tables.mass);
+  free(d->tables.moment_x);
+  free(d->tables.moment_y);
+  delete d;
+}
+
 /**
  * @brief Calculates distance between 2 points.
  * @param x x position of point1.
@@ -38,58 +177,415 @@ double dist(int x, int y, int ux, int uy) {
   return sqrt((x - ux) * (x - ux) + (y - uy) * (y - uy));
 }
 
+/**
+ * @brief Scales a distance from the tuned frame size to the processed one.
+ * @param distance The distance in pixels of the tuned frame size.
+ * @param unit The size of the processed frame relative to the tuned one.
+ * @returns The distance in processed pixels, rounded down.
+ */
+int scale_distance(int distance, double unit) {
+  return (int) (distance * unit);
+}
+
+/**
+ * @brief Gets the table of distance weights for a pyramid level.
+ * Entry (dx, dy) holds 20 / (20 + r) in FORCE_WEIGHT_SHIFT fixed point,
+ * where r is the tuned frame distance of the offset (dx - radius,
+ * dy - radius), so no square roots are needed while summing forces.
+ * @param d The detection tables.
+ * @param level The pyramid level, 0 for full resolution.
+ * @param unit The size of the full resolution frame relative to the tuned one.
+ * @returns The level's weights.
+ */
+force_kernel_t *get_force_kernel(detection_t *d, int level, double unit) {
+  force_kernel_t *k = &d->kernels[level];
+
+  if (!k->weights || k->unit != unit) {
+    free(k->weights);
+    double step = (1 << level) / unit;
+    k->unit = unit;
+    k->radius = scale_distance(FORCE_RADIUS, unit) >> level;
+    int size = 2 * k->radius;
+    if (posix_memalign((void **) &k->weights, 64, sizeof(uint16_t) * size * size)) {
+      perror("Unable to allocate memory for force weights");
+      exit(EXIT_FAILURE);
+    }
+
+    for (int dy = 0; dy < size; dy++) {
+      for (int dx = 0; dx < size; dx++) {
+        double dist_scale = (double) (20) / ((double) (20 + step * dist(dx, dy, k->radius, k->radius)));
+        k->weights[dy * size + dx] = (uint16_t) lrint(dist_scale * (1 << FORCE_WEIGHT_SHIFT));
+      }
+    }
+  }
+
+  return k;
+}
+
+/**
+ * @brief Builds the smaller levels of the mask pyramid.
+ * Each level is built from the one above it, averaging blocks of 2x2 pixels.
+ * @param d The detection tables.
+ * @param frame The mask, used as level 0.
+ * @param levels The number of levels to build.
+ */
+void build_mask_pyramid(detection_t *d, const cv::Mat &frame, int levels) {
+  d->pyramid[0] = frame;
+
+  for (int l = 1; l < levels; l++) {
+    const cv::Mat &src = d->pyramid[l - 1];
+    int rows = src.rows / 2;
+    int cols = src.cols / 2;
+    if (d->pyramid[l].empty() || d->pyramid[l].rows != rows || d->pyramid[l].cols != cols) {
+      release_mat(&d->pyramid[l]);
+      d->pyramid[l] = acquire_mat(rows, cols, CV_8UC1);
+    }
+    cv::Mat &dst = d->pyramid[l];
+
+    for (int y = 0; y < dst.rows; y++) {
+      const unsigned char *top = src.ptr<unsigned char>(2 * y);
+      const unsigned char *bottom = src.ptr<unsigned char>(2 * y + 1);
+      unsigned char *out = dst.ptr<unsigned char>(y);
+      for (int x = 0; x < dst.cols; x++) {
+        out[x] = (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2;
+      }
+    }
+  }
+}
+
+/**
+ * @brief The arguments of force_band.
+ */
+typedef struct {
+  /** The mask at this level. */
+  cv::Mat image;
+  /** The level's distance weights. */
+  force_kernel_t *k;
+  /** The point, in this level's pixels. */
+  int cx;
+  int cy;
+  /** The clipped square of pixels pulling on the point. */
+  int x_start;
+  int x_end;
+  int y_start;
+  /** The x force summed over each band. */
+  int64_t force_x[MAX_BANDS];
+  /** The y force summed over each band. */
+  int64_t force_y[MAX_BANDS];
+} force_args_t;
+
+/**
+ * @brief Sums the forces on a point from a band of rows, see apply_force_level.
+ */
+void force_band(int start, int end, int band, void *arg) {
+  force_args_t *a = (force_args_t *) arg;
+  int radius = a->k->radius;
+  int size = 2 * radius;
+  int cx = a->cx;
+  int cy = a->cy;
+  int x_start = a->x_start;
+  int x_end = a->x_end;
+
+  // Force accumulators, in units of pixel value times fixed point weight.
+  int64_t force_x = 0;
+  int64_t force_y = 0;
+
+  for (int y = a->y_start + start; y < a->y_start + end; y++) {
+    const unsigned char *row = a->image.ptr<unsigned char>(y);
+    const uint16_t *weights = a->k->weights + (y - cy + radius) * size + x_start - cx + radius;
+
+    // Pixel colour times distance weight, summed along the row and weighted
+    // by the x offset.
+    int64_t row_weight = 0;
+    int64_t row_force_x = 0;
+    for (int x = x_start; x < x_end; x++) {
+      int weight = row[x] * weights[x - x_start];
+      row_weight += weight;
+      row_force_x += weight * (x - cx);
+    }
+
+    force_x += row_force_x;
+    force_y += row_weight * (y - cy);
+  }
+
+  a->force_x[band] = force_x;
+  a->force_y[band] = force_y;
+}
+
+/**
+ * @brief Applies forces to a single point using one level of the pyramid.
+ * Each pixel of level l stands for s by s tuned frame pixels, s pixels away
+ * per step where s = 2^l / unit, so the sum is scaled by s^3 to match the
+ * tuned frame, and the move is scaled back by unit. The rows are split into
+ * bands on the thread pool, and the band sums are added up in band order.
+ * @param d The detection tables.
+ * @param image The mask at this level.
+ * @param level The pyramid level, 0 for full resolution.
+ * @param unit The size of the full resolution frame relative to the tuned one.
+ * @param px A pointer to the full resolution x position of the point.
+ * @param py A pointer to the full resolution y position of the point.
+ * @param initial The initial x force to apply to the point.
+ * @param scale Scaling for how much the point moves.
+ */
+void apply_force_level(detection_t *d, const cv::Mat &image, int level, double unit, int *px, int *py,
+                       double initial, double scale) {
+  force_args_t a;
+  a.image = image;
+  a.k = get_force_kernel(d, level, unit);
+  int radius = a.k->radius;
+  a.cx = *px >> level;
+  a.cy = *py >> level;
+
+  // Clip the square of pixels within radius distance to the frame, skipping
+  // the first row and column as they always have been.
+  a.x_start = a.cx - radius > 1 ? a.cx - radius : 1;
+  a.x_end = a.cx + radius < image.cols ? a.cx + radius : image.cols;
+  a.y_start = a.cy - radius > 1 ? a.cy - radius : 1;
+  int y_end = a.cy + radius < image.rows ? a.cy + radius : image.rows;
+  int rows = y_end > a.y_start ? y_end - a.y_start : 0;
+
+  int bands = band_count(rows, MIN_BAND_ROWS);
+  run_bands(rows, bands, force_band, &a);
+
+  int64_t force_x = 0;
+  int64_t force_y = 0;
+  for (int band = 0; band < bands; band++) {
+    force_x += a.force_x[band];
+    force_y += a.force_y[band];
+  }
+
+  double step = (1 << level) / unit;
+  double level_scale = scale * step * step * step / (1 << FORCE_WEIGHT_SHIFT);
+  double new_x = unit * (initial + level_scale * force_x);
+  double new_y = unit * level_scale * force_y;
+
+  // Update hands positions.
+  *px = *px + new_x;
+  *py = *py + new_y;
+}
+
 /**
  * @brief Applies forces to a single point, converging it to the users hand.
- * @param frame The webcam image.
+ * @param d The detection tables.
+ * @param frame The webcam image, at the size the constants were tuned on.
  * @param px A pointer to the x position of the point.
  * @param py A pointer to the y position of the point.
  * @param initial The initial x force to apply to the point.
  * @param scale Scaling for how much the point moves.
  */
-void apply_force_point(IplImage *frame, int *px, int *py, double initial, double scale) {
+void apply_force_point(detection_t *d, const cv::Mat &frame, int *px, int *py, double initial, double scale) {
+  apply_force_level(d, frame, 0, 1, px, py, initial, scale);
+}
 
-  // Force accumulators.
-  double new_x = initial;
-  double new_y = 0;
+/**
+ * @brief Computes the force field of a frame.
+ * Each kernel holds the pull a white pixel at that offset has on a point, and
+ * is stored wrapped around so that negative offsets sit at the far edges.
+ * The frame is padded by the radius so the circular correlation never wraps
+ * pixels from one edge onto the other.
+ * @param d The detection tables, the field is kept in them.
+ * @param frame The webcam image.
+ * @param unit The size of the frame relative to the tuned one.
+ */
+void compute_force_field(detection_t *d, const cv::Mat &frame, double unit) {
+  force_field_t *f = &d->field;
+  int radius = scale_distance(FORCE_RADIUS, unit);
+  int rows = cv::getOptimalDFTSize(frame.rows + 2 * radius);
+  int cols = cv::getOptimalDFTSize(frame.cols + 2 * radius);
 
-  double pixel_weight;
-  double dist_scale;
-  int radius = 100;
+  if (f->width != frame.cols || f->height != frame.rows || f->unit != unit) {
+    cv::Mat kx = cv::Mat::zeros(rows, cols, CV_32F);
+    cv::Mat ky = cv::Mat::zeros(rows, cols, CV_32F);
+    for (int dy = -radius; dy < radius; dy++) {
+      for (int dx = -radius; dx < radius; dx++) {
+        double dist_scale = (double) (20) / ((double) (20 + dist(dx, dy, 0, 0) / unit));
+        kx.at<float>((dy + rows) % rows, (dx + cols) % cols) = (float) (dist_scale * dx);
+        ky.at<float>((dy + rows) % rows, (dx + cols) % cols) = (float) (dist_scale * dy);
+      }
+    }
+    cv::dft(kx, f->kernel_x);
+    cv::dft(ky, f->kernel_y);
+    f->padded = cv::Mat::zeros(rows, cols, CV_32F);
+    f->width = frame.cols;
+    f->height = frame.rows;
+    f->unit = unit;
+  }
 
-  // Loop through all pixels around the points within radius distance.
-  for (int y = *py - radius; y < *py + radius; y++) {
-    for (int x = *px - radius; x < *px + radius; x++) {
-      if (x > 0 && x < frame->width && y > 0 && y < frame->height) {
-        // Weight based on pixel colour.
-        pixel_weight = (double) ((unsigned char) (frame->imageData[y * frame->widthStep + x])) * scale;
+  cv::Mat roi = f->padded(cv::Rect(0, 0, frame.cols, frame.rows));
+  frame.convertTo(roi, CV_32F);
+  // apply_force_point never reads the first row or column.
+  roi.row(0).setTo(0);
+  roi.col(0).setTo(0);
 
-        // Weight based on distance.
-        dist_scale = (double) (20) / ((double) (20 + dist(x, y, *px, *py)));
+  cv::dft(f->padded, f->spectrum, 0, frame.rows);
+  cv::mulSpectrums(f->spectrum, f->kernel_x, f->product, 0, true);
+  cv::dft(f->product, f->x, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, frame.rows);
+  cv::mulSpectrums(f->spectrum, f->kernel_y, f->product, 0, true);
+  cv::dft(f->product, f->y, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, frame.rows);
+}
 
-        // Add force to accumulators.
-        new_x += pixel_weight * dist_scale * (x - *px);
-        new_y += pixel_weight * dist_scale * (y - *py);
-      }
-    }
+/**
+ * @brief Applies forces to a single point using the force field.
+ * Gives the same result as apply_force_point, but each call is one lookup.
+ * Points that have drifted off the frame fall back to summing the forces.
+ * @param d The detection tables.
+ * @param frame The webcam image the field was computed for.
+ * @param unit The size of the frame relative to the tuned one.
+ * @param px A pointer to the x position of the point.
+ * @param py A pointer to the y position of the point.
+ * @param initial The initial x force to apply to the point.
+ * @param scale Scaling for how much the point moves.
+ */
+void apply_field_point(detection_t *d, const cv::Mat &frame, double unit, int *px, int *py, double initial,
+                       double scale) {
+  force_field_t *f = &d->field;
+  if (*px < 0 || *px >= f->width || *py < 0 || *py >= f->height) {
+    apply_force_level(d, frame, 0, unit, px, py, initial, scale);
+    return;
   }
 
+  double field_scale = scale / (unit * unit * unit);
+  double new_x = unit * (initial + field_scale * f->x.at<float>(*py, *px));
+  double new_y = unit * field_scale * f->y.at<float>(*py, *px);
+
   // Update hands positions.
   *px = *px + new_x;
   *py = *py + new_y;
 }
 
+/**
+ * @brief Builds the summed-area tables of a frame in a single pass.
+ * @param t The tables to fill, remade if they are for another frame size.
+ * @param frame The webcam image.
+ */
+void compute_mass_tables(mass_tables_t *t, const cv::Mat &frame) {
+  int width = frame.cols + 1;
+  int height = frame.rows + 1;
+
+  if (t->width != width || t->height != height) {
+    free(t->mass);
+    free(t->moment_x);
+    free(t->moment_y);
+    t->width = width;
+    t->height = height;
+    // The first row is all zeros, and is never written to again.
+    t->mass = (int64_t *) calloc(width * height, sizeof(int64_t));
+    t->moment_x = (int64_t *) calloc(width * height, sizeof(int64_t));
+    t->moment_y = (int64_t *) calloc(width * height, sizeof(int64_t));
+  }
+
+  for (int y = 0; y < frame.rows; y++) {
+    const unsigned char *row = frame.ptr<unsigned char>(y);
+    int64_t mass = 0;
+    int64_t moment_x = 0;
+    int64_t *above = t->mass + y * width;
+    int64_t *above_x = t->moment_x + y * width;
+    int64_t *above_y = t->moment_y + y * width;
+    int64_t *out = above + width;
+    int64_t *out_x = above_x + width;
+    int64_t *out_y = above_y + width;
+
+    out[0] = 0;
+    out_x[0] = 0;
+    out_y[0] = 0;
+    for (int x = 0; x < frame.cols; x++) {
+      mass += row[x];
+      moment_x += row[x] * x;
+      out[x + 1] = above[x + 1] + mass;
+      out_x[x + 1] = above_x[x + 1] + moment_x;
+      out_y[x + 1] = above_y[x + 1] + mass * y;
+    }
+  }
+}
+
+/**
+ * @brief Sums a summed-area table over a rectangle.
+ * @param t The tables the table is one of.
+ * @param table The table to sum.
+ * @param x0 The left edge of the rectangle, inclusive.
+ * @param y0 The top edge of the rectangle, inclusive.
+ * @param x1 The right edge of the rectangle, exclusive.
+ * @param y1 The bottom edge of the rectangle, exclusive.
+ * @returns The sum over the rectangle.
+ */
+int64_t table_sum(const mass_tables_t *t, const int64_t *table, int x0, int y0, int x1, int y1) {
+  int width = t->width;
+  return table[y1 * width + x1] - table[y0 * width + x1] - table[y1 * width + x0] + table[y0 * width + x0];
+}
+
+/**
+ * @brief Moves a point to the centroid of the skin in the window around it.
+ * Repeats until the point stops moving, like mean-shift. The window is clipped
+ * to the region the point is allowed in, so the point can never leave it.
+ * @param t The summed-area tables of the frame.
+ * @param px A pointer to the x position of the point.
+ * @param py A pointer to the y position of the point.
+ * @param radius The distance from the point to the edge of its window.
+ * @param rx0 The left edge of the region, inclusive.
+ * @param ry0 The top edge of the region, inclusive.
+ * @param rx1 The right edge of the region, exclusive.
+ * @param ry1 The bottom edge of the region, exclusive.
+ */
+void shift_to_centroid(const mass_tables_t *t, int *px, int *py, int radius, int rx0, int ry0, int rx1, int ry1) {
+  for (int i = 0; i < CENTROID_ITERATIONS; i++) {
+    int x0 = *px - radius > rx0 ? *px - radius : rx0;
+    int y0 = *py - radius > ry0 ? *py - radius : ry0;
+    int x1 = *px + radius < rx1 ? *px + radius : rx1;
+    int y1 = *py + radius < ry1 ? *py + radius : ry1;
+    if (x0 >= x1 || y0 >= y1) {
+      return;
+    }
+
+    int64_t mass = table_sum(t, t->mass, x0, y0, x1, y1);
+    if (mass == 0) {
+      return;
+    }
+    int x = table_sum(t, t->moment_x, x0, y0, x1, y1) / mass;
+    int y = table_sum(t, t->moment_y, x0, y0, x1, y1) / mass;
+
+    if (x == *px && y == *py) {
+      return;
+    }
+    *px = x;
+    *py = y;
+  }
+}
+
+/**
+ * @brief Picks the pyramid level an iteration of detect_hands runs at.
+ * The early iterations move the points furthest and need the least
+ * precision, so they run on the smallest levels, working up to full
+ * resolution for the last FINE_ITERATIONS.
+ * @param i The iteration.
+ * @param levels The number of pyramid levels.
+ * @returns The level to use, 0 for full resolution.
+ */
+int iteration_level(int i, int levels) {
+  if (i >= ITERATIONS - FINE_ITERATIONS) {
+    return 0;
+  }
+  return levels - 1 - i * (levels - 1) / (ITERATIONS - FINE_ITERATIONS);
+}
+
 /**
  * @brief Applies forces to left and right hand points.
+ * @param d The detection tables.
  * @param frame The webcam image.
  * @param h The hands struct to update.
  * @param scale Scaling for how much the point moves.
+ * @param level The pyramid level to use in the iterative mode.
  */
-void apply_force(IplImage *frame, hands_t *h, double scale) {
+void apply_force(detection_t *d, const cv::Mat &frame, hands_t *h, double scale, int level) {
   int force = 1;
 
   // Apply force to left and right hand points.
-  apply_force_point(frame, &h->left_x, &h->left_y, -force, scale);
-  apply_force_point(frame, &h->right_x, &h->right_y, force, scale);
+  if (h->mode == detect_field) {
+    apply_field_point(d, frame, h->scale, &h->left_x, &h->left_y, -force, scale);
+    apply_field_point(d, frame, h->scale, &h->right_x, &h->right_y, force, scale);
+  } else {
+    apply_force_level(d, d->pyramid[level], level, h->scale, &h->left_x, &h->left_y, -force, scale);
+    apply_force_level(d, d->pyramid[level], level, h->scale, &h->right_x, &h->right_y, force, scale);
+  }
 }
 
 /**
@@ -107,33 +603,80 @@ bool outside_range(int x, int y, int rx, int ry, int rwidth, int rheight) {
 }
 
 /**
- * @brief Detects new positions of the users hands.
- * @param frame The newest webcam frame.
- * @param hands The last position of the hands, is updated to be the new position.
+ * @brief Puts the hands back to their start positions if they are lost.
+ * Places them on the first frame, and again whenever a point drifts out of
+ * the part of the frame where that hand is expected.
+ * @param hands The hands to check, are moved if they need resetting.
+ * @param width The width of the frame.
+ * @param height The height of the frame.
+ * @returns Whether either hand was moved.
  */
-void detect_hands(IplImage *frame, hands_t *hands) {
+bool reset_hands(hands_t *hands, int width, int height) {
+  bool reset = false;
 
   // Init hands to correct positions if it's the first frame.
   if (hands == NULL || hands->is_null) {
-    hands->left_x = 2 * frame->width / 7;
-    hands->left_y = frame->height / 2;
-    hands->right_x = 5 * frame->width / 7;
-    hands->right_y = frame->height / 2;
+    hands->left_x = 2 * width / 7;
+    hands->left_y = height / 2;
+    hands->right_x = 5 * width / 7;
+    hands->right_y = height / 2;
     hands->is_null = false;
+    reset = true;
   }
 
   // Reset hands position if the points drift off screen.
-  if (outside_range(hands->left_x, hands->left_y, 0, frame->height * 0.1, frame->width * 0.3, frame->height * 0.8)) {
-    hands->left_x = 2 * frame->width / 7;
-    hands->left_y = frame->height / 2;
+  if (outside_range(hands->left_x, hands->left_y, 0, height * 0.1, width * 0.3, height * 0.8)) {
+    hands->left_x = 2 * width / 7;
+    hands->left_y = height / 2;
+    reset = true;
   }
-  if (outside_range(hands->right_x, hands->right_y, frame->width * 0.7, frame->height * 0.1, frame->width * 0.3, frame->height * 0.8)) {
-    hands->right_x = 5 * frame->width / 7;
-    hands->right_y = frame->height / 2;
+  if (outside_range(hands->right_x, hands->right_y, width * 0.7, height * 0.1, width * 0.3, height * 0.8)) {
+    hands->right_x = 5 * width / 7;
+    hands->right_y = height / 2;
+    reset = true;
+  }
+
+  return reset;
+}
+
+/**
+ * @brief Finds how far from a hand detect_hands may read the frame.
+ * @param hands The hands, only the detection mode and scale are used.
+ * @returns The half width of the square around each hand that is read.
+ */
+int hands_reach(hands_t *hands) {
+  return scale_distance(hands->mode == detect_centroid ? CENTROID_RADIUS : FORCE_RADIUS, hands->scale);
+}
+
+/**
+ * @brief Detects new positions of the users hands.
+ * @param d The tables kept from the last frame, which are updated.
+ * @param frame The newest webcam frame.
+ * @param hands The last position of the hands, is updated to be the new position.
+ */
+void detect_hands(detection_t *d, const cv::Mat &frame, hands_t *hands) {
+  reset_hands(hands, frame.cols, frame.rows);
+
+  if (hands->mode == detect_centroid) {
+    compute_mass_tables(&d->tables, frame);
+    int radius = scale_distance(CENTROID_RADIUS, hands->scale);
+    shift_to_centroid(&d->tables, &hands->left_x, &hands->left_y, radius, 0, frame.rows * 0.1,
+                      frame.cols * 0.3, frame.rows * 0.9);
+    shift_to_centroid(&d->tables, &hands->right_x, &hands->right_y, radius, frame.cols * 0.7, frame.rows * 0.1,
+                      frame.cols, frame.rows * 0.9);
+    return;
+  }
+
+  int levels = 1;
+  if (hands->mode == detect_field) {
+    compute_force_field(d, frame, hands->scale);
+  } else {
+    levels = hands->pyramid_levels;
   }
+  build_mask_pyramid(d, frame, levels);
 
   // Converge the points to the persons arms
   for (int i = 0; i < ITERATIONS; i++) {
-    apply_force(frame, hands, 0.000005 * (ITERATIONS - i) / ITERATIONS);
+    apply_force(d, frame, hands, 0.000005 * (ITERATIONS - i) / ITERATIONS, iteration_level(i, levels));
   }
 }
@@ -0,0 +1,552 @@
+/**
+ * @file detection_tests.cpp
+ * @brief Tests for hand detection.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/wait.h>
+#include "cv.h"
+#include "highgui.h"
+#include "uchar_array.c"
+#include "thread_pool.c"
+#include "frame_pool.c"
+#include "raw_video.c"
+#include "frame_source.c"
+#include "calibration.c"
+#include "threshold.c"
+#include "filter.c"
+#include "detection.c"
+#include "vision.c"
+#include "test_fixtures.c"
+
+typedef void test_t(void);
+
+void run_test(test_t test) {
+  printf("Running tests: ");
+  test();
+  printf("Passed!\n");
+}
+
+/**
+ * @brief Detects hands over a sequence of frames with the given mode.
+ */
+hands_t *track(detection_mode_t mode, const cv::Mat *frames, int n) {
+  detection_t *d = init_detection();
+  hands_t *hands = init_hands();
+  hands->mode = mode;
+  for (int i = 0; i < n; i++) {
+    detect_hands(d, frames[i], hands);
+  }
+  free_detection(d);
+  return hands;
+}
+
+/**
+ * @brief The original floating point force sum, for comparison.
+ */
+void reference_force_point(const cv::Mat &frame, int *px, int *py, double initial, double scale) {
+  double new_x = initial;
+  double new_y = 0;
+  for (int y = *py - FORCE_RADIUS; y < *py + FORCE_RADIUS; y++) {
+    for (int x = *px - FORCE_RADIUS; x < *px + FORCE_RADIUS; x++) {
+      if (x > 0 && x < frame.cols && y > 0 && y < frame.rows) {
+        double pixel_weight = (double) frame.at<unsigned char>(y, x) * scale;
+        double dist_scale = 20.0 / (20.0 + dist(x, y, *px, *py));
+        new_x += pixel_weight * dist_scale * (x - *px);
+        new_y += pixel_weight * dist_scale * (y - *py);
+      }
+    }
+  }
+  *px = *px + new_x;
+  *py = *py + new_y;
+}
+
+void test_force_point_matches_sum(void) {
+  printf("force_point_matches_sum\n");
+  cv::Mat frame = make_hands_frame(90, 100, 230, 140, 30);
+  detection_t *d = init_detection();
+
+  int points[][2] = {{0, 0}, {1, 1}, {90, 100}, {60, 180}, {160, 120}, {319, 239}, {250, 5}, {-50, 400}};
+  for (int i = 0; i < (int) (sizeof(points) / sizeof(points[0])); i++) {
+    for (int j = 1; j <= ITERATIONS; j++) {
+      double scale = 0.000005 * j / ITERATIONS;
+      int fixed_x = points[i][0];
+      int fixed_y = points[i][1];
+      int reference_x = points[i][0];
+      int reference_y = points[i][1];
+      apply_force_point(d, frame, &fixed_x, &fixed_y, 1, scale);
+      reference_force_point(frame, &reference_x, &reference_y, 1, scale);
+      assert(abs(fixed_x - reference_x) <= 1);
+      assert(abs(fixed_y - reference_y) <= 1);
+    }
+  }
+  free_detection(d);
+}
+
+/**
+ * @brief detect_hands in the iterative mode, with the floating point force sum.
+ */
+void reference_detect_hands(const cv::Mat &frame, hands_t *hands) {
+  reset_hands(hands, frame.cols, frame.rows);
+  for (int i = 0; i < ITERATIONS; i++) {
+    double scale = 0.000005 * (ITERATIONS - i) / ITERATIONS;
+    reference_force_point(frame, &hands->left_x, &hands->left_y, -1, scale);
+    reference_force_point(frame, &hands->right_x, &hands->right_y, 1, scale);
+  }
+}
+
+void test_force_point_detect_hands(void) {
+  printf("force_point_detect_hands\n");
+  // Hands moving across the frame, so each frame starts from where the last one converged,
+  // and each detector follows them on its own, so any drift adds up.
+  cv::Mat frames[8];
+  for (int i = 0; i < 8; i++) {
+    frames[i] = make_hands_frame(60 + 5 * i, 80 + 7 * i, 260 - 4 * i, 160 - 6 * i, 20 + i);
+  }
+
+  detection_t *d = init_detection();
+  hands_t *fixed = init_hands();
+  hands_t *reference = init_hands();
+  for (int i = 0; i < 8; i++) {
+    detect_hands(d, frames[i], fixed);
+    reference_detect_hands(frames[i], reference);
+    assert(abs(fixed->left_x - reference->left_x) <= 1);
+    assert(abs(fixed->left_y - reference->left_y) <= 1);
+    assert(abs(fixed->right_x - reference->right_x) <= 1);
+    assert(abs(fixed->right_y - reference->right_y) <= 1);
+  }
+  free(fixed);
+  free(reference);
+  free_detection(d);
+}
+
+void test_field_matches_sum(void) {
+  printf("field_matches_sum\n");
+  cv::Mat frame = make_hands_frame(90, 100, 230, 140, 30);
+  detection_t *d = init_detection();
+  compute_force_field(d, frame, 1);
+
+  int points[][2] = {{0, 0}, {1, 1}, {90, 100}, {60, 180}, {160, 120}, {319, 239}, {250, 5}};
+  for (int i = 0; i < (int) (sizeof(points) / sizeof(points[0])); i++) {
+    int px = points[i][0];
+    int py = points[i][1];
+    double fx = 0;
+    double fy = 0;
+    for (int y = py - FORCE_RADIUS; y < py + FORCE_RADIUS; y++) {
+      for (int x = px - FORCE_RADIUS; x < px + FORCE_RADIUS; x++) {
+        if (x > 0 && x < frame.cols && y > 0 && y < frame.rows) {
+          double weight = frame.at<unsigned char>(y, x);
+          double dist_scale = 20.0 / (20.0 + dist(x, y, px, py));
+          fx += weight * dist_scale * (x - px);
+          fy += weight * dist_scale * (y - py);
+        }
+      }
+    }
+    // The field is single precision, so compare relative to the largest term.
+    double tolerance = 1e-4 * 255 * 20 * FORCE_RADIUS * FORCE_RADIUS;
+    assert(fabs(d->field.x.at<float>(py, px) - fx) < tolerance);
+    assert(fabs(d->field.y.at<float>(py, px) - fy) < tolerance);
+  }
+  free_detection(d);
+}
+
+void test_field_detect_hands(void) {
+  printf("field_detect_hands\n");
+  cv::Mat frames[6];
+  for (int i = 0; i < 6; i++) {
+    frames[i] = make_hands_frame(70 + 4 * i, 90 + 6 * i, 250 - 3 * i, 150 - 5 * i, 25);
+  }
+
+  for (int n = 1; n <= 6; n++) {
+    hands_t *iterative = track(detect_iterative, frames, n);
+    hands_t *field = track(detect_field, frames, n);
+    assert(abs(iterative->left_x - field->left_x) <= 1);
+    assert(abs(iterative->left_y - field->left_y) <= 1);
+    assert(abs(iterative->right_x - field->right_x) <= 1);
+    assert(abs(iterative->right_y - field->right_y) <= 1);
+    free(iterative);
+    free(field);
+  }
+}
+
+void test_pyramid_detect_hands(void) {
+  printf("pyramid_detect_hands\n");
+  cv::Mat frames[6];
+  for (int i = 0; i < 6; i++) {
+    frames[i] = make_hands_frame(60 + 4 * i, 90 + 6 * i, 250 - 3 * i, 150 - 5 * i, 25);
+  }
+
+  for (int levels = 2; levels <= MAX_PYRAMID_LEVELS; levels++) {
+    detection_t *full_detection = init_detection();
+    detection_t *pyramid_detection = init_detection();
+    hands_t *full = init_hands();
+    hands_t *pyramid = init_hands();
+    pyramid->pyramid_levels = levels;
+    for (int i = 0; i < 6; i++) {
+      detect_hands(full_detection, frames[i], full);
+      detect_hands(pyramid_detection, frames[i], pyramid);
+      assert(abs(full->left_x - pyramid->left_x) <= 2);
+      assert(abs(full->left_y - pyramid->left_y) <= 2);
+      assert(abs(full->right_x - pyramid->right_x) <= 2);
+      assert(abs(full->right_y - pyramid->right_y) <= 2);
+    }
+    free(full);
+    free(pyramid);
+    free_detection(full_detection);
+    free_detection(pyramid_detection);
+  }
+}
+
+void test_mass_tables(void) {
+  printf("mass_tables\n");
+  cv::Mat frame = make_hands_frame(90, 100, 230, 140, 30);
+  detection_t *d = init_detection();
+  mass_tables_t *t = &d->tables;
+  compute_mass_tables(t, frame);
+
+  int rects[][4] = {{0, 0, TEST_WIDTH, TEST_HEIGHT}, {60, 70, 120, 130}, {10, 200, 11, 201}, {200, 100, 300, 240}};
+  for (int i = 0; i < (int) (sizeof(rects) / sizeof(rects[0])); i++) {
+    int64_t mass = 0;
+    int64_t moment_x = 0;
+    int64_t moment_y = 0;
+    for (int y = rects[i][1]; y < rects[i][3]; y++) {
+      for (int x = rects[i][0]; x < rects[i][2]; x++) {
+        int value = frame.at<unsigned char>(y, x);
+        mass += value;
+        moment_x += value * x;
+        moment_y += value * y;
+      }
+    }
+    assert(table_sum(t, t->mass, rects[i][0], rects[i][1], rects[i][2], rects[i][3]) == mass);
+    assert(table_sum(t, t->moment_x, rects[i][0], rects[i][1], rects[i][2], rects[i][3]) == moment_x);
+    assert(table_sum(t, t->moment_y, rects[i][0], rects[i][1], rects[i][2], rects[i][3]) == moment_y);
+  }
+  free_detection(d);
+}
+
+void test_centroid_detect_hands(void) {
+  printf("centroid_detect_hands\n");
+  cv::Mat frames[6];
+  for (int i = 0; i < 6; i++) {
+    frames[i] = make_hands_frame(50 + 4 * i, 90 + 6 * i, 270 - 3 * i, 150 - 5 * i, 25);
+  }
+
+  detection_t *d = init_detection();
+  hands_t *hands = init_hands();
+  hands->mode = detect_centroid;
+  for (int i = 0; i < 6; i++) {
+    detect_hands(d, frames[i], hands);
+    assert(abs(hands->left_x - (50 + 4 * i)) <= 1);
+    assert(abs(hands->left_y - (90 + 6 * i)) <= 1);
+    assert(abs(hands->right_x - (270 - 3 * i)) <= 1);
+    assert(abs(hands->right_y - (150 - 5 * i)) <= 1);
+  }
+  free(hands);
+  free_detection(d);
+}
+
+void test_denoise_region(void) {
+  printf("denoise_region\n");
+  cv::Mat skin(TEST_HEIGHT, TEST_WIDTH, CV_8UC1);
+  srand(1);
+  for (int y = 0; y < TEST_HEIGHT; y++) {
+    for (int x = 0; x < TEST_WIDTH; x++) {
+      skin.at<unsigned char>(y, x) = rand() % 3 == 0 ? 0 : 255;
+    }
+  }
+  cv::Mat full(TEST_HEIGHT, TEST_WIDTH, CV_8UC1);
+  cv::Mat part(TEST_HEIGHT, TEST_WIDTH, CV_8UC1);
+  denoise_mask(skin, full, DENOISE_RADIUS);
+
+  cv::Rect regions[] = {cv::Rect(0, 0, 40, 30), cv::Rect(100, 80, 1, 1), cv::Rect(37, 51, 90, 120),
+                        cv::Rect(TEST_WIDTH - 20, TEST_HEIGHT - 3, 20, 3)};
+  for (int i = 0; i < (int) (sizeof(regions) / sizeof(regions[0])); i++) {
+    denoise_region(skin, part, DENOISE_RADIUS, regions[i]);
+    for (int y = regions[i].y; y < regions[i].y + regions[i].height; y++) {
+      for (int x = regions[i].x; x < regions[i].x + regions[i].width; x++) {
+        assert(part.at<unsigned char>(y, x) == full.at<unsigned char>(y, x));
+      }
+    }
+  }
+}
+
+void test_roi_detect_hands(void) {
+  printf("roi_detect_hands\n");
+  calibration_t *c = make_test_calibration();
+
+  vision_t *full = init_vision(0, 1);
+  vision_t *roi = init_vision(4, 1);
+  hands_t *full_hands = init_hands();
+  hands_t *roi_hands = init_hands();
+  for (int i = 0; i < 10; i++) {
+    cv::Mat frame = make_colour_frame(60 + 3 * i, 90 + 5 * i, 250 - 3 * i, 150 - 4 * i, 25);
+    process_frame(full, frame, c, full_hands);
+    process_frame(roi, frame, c, roi_hands);
+    assert(full_hands->left_x == roi_hands->left_x);
+    assert(full_hands->left_y == roi_hands->left_y);
+    assert(full_hands->right_x == roi_hands->right_x);
+    assert(full_hands->right_y == roi_hands->right_y);
+  }
+  assert(roi->frames_since_full == 4);
+
+  free(full_hands);
+  free(roi_hands);
+  free_vision(full);
+  free_vision(roi);
+  free_calibration(c);
+}
+
+/**
+ * @brief Checks detection tables are the ones for frames of a given width.
+ */
+void assert_tables_for(const detection_t *d, detection_mode_t mode, int width, double unit) {
+  if (mode == detect_field) {
+    assert(d->field.width == width && d->field.unit == unit);
+  } else if (mode == detect_centroid) {
+    assert(d->tables.width == width + 1);
+  } else {
+    assert(d->kernels[0].unit == unit);
+  }
+}
+
+void test_scaled_detect_hands(void) {
+  printf("scaled_detect_hands\n");
+  calibration_t *c = make_test_calibration();
+
+  detection_mode_t modes[] = {detect_iterative, detect_field, detect_centroid};
+  for (int m = 0; m < 3; m++) {
+    vision_t *full = init_vision(0, 1);
+    vision_t *half = init_vision(0, 0.5);
+    hands_t *full_hands = init_hands();
+    hands_t *half_hands = init_hands();
+    full_hands->mode = modes[m];
+    half_hands->mode = modes[m];
+    for (int i = 0; i < 6; i++) {
+      cv::Mat frame = make_colour_frame(60 + 4 * i, 90 + 6 * i, 250 - 3 * i, 150 - 5 * i, 25);
+      process_frame(full, frame, c, full_hands);
+      process_frame(half, frame, c, half_hands);
+      assert(abs(full_hands->left_x - half_hands->left_x) <= 4);
+      assert(abs(full_hands->left_y - half_hands->left_y) <= 4);
+      assert(abs(full_hands->right_x - half_hands->right_x) <= 4);
+      assert(abs(full_hands->right_y - half_hands->right_y) <= 4);
+      // Running the other size in between must not have rebuilt either pipeline's tables.
+      assert_tables_for(full->detection, modes[m], TEST_WIDTH, 1);
+      assert_tables_for(half->detection, modes[m], TEST_WIDTH / 2, 0.5);
+    }
+    free(full_hands);
+    free(half_hands);
+    free_vision(full);
+    free_vision(half);
+  }
+  free_calibration(c);
+}
+
+void test_thread_pool_matches_serial(void) {
+  printf("thread_pool_matches_serial\n");
+  calibration_t *c = make_test_calibration();
+
+  vision_t *serial = init_vision(0, 1);
+  vision_t *banded = init_vision(0, 1);
+  hands_t *serial_hands = init_hands();
+  hands_t *banded_hands = init_hands();
+  for (int i = 0; i < 4; i++) {
+    cv::Mat frame = make_colour_frame(60 + 4 * i, 90 + 6 * i, 250 - 3 * i, 150 - 5 * i, 25);
+    process_frame(serial, frame, c, serial_hands);
+    init_thread_pool(4);
+    process_frame(banded, frame, c, banded_hands);
+    free_thread_pool();
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+      assert(memcmp(serial->mask.ptr<unsigned char>(y), banded->mask.ptr<unsigned char>(y), TEST_WIDTH) == 0);
+    }
+    assert(serial_hands->left_x == banded_hands->left_x);
+    assert(serial_hands->left_y == banded_hands->left_y);
+    assert(serial_hands->right_x == banded_hands->right_x);
+    assert(serial_hands->right_y == banded_hands->right_y);
+  }
+
+  free(serial_hands);
+  free(banded_hands);
+  free_vision(serial);
+  free_vision(banded);
+  free_calibration(c);
+}
+
+void test_frame_pool_steady_state(void) {
+  printf("frame_pool_steady_state\n");
+  calibration_t *c = make_test_calibration();
+
+  vision_t *vision = init_vision(3, 0.5);
+  hands_t *hands = init_hands();
+  hands->pyramid_levels = 3;
+  long allocations = 0;
+  for (int i = 0; i < 8; i++) {
+    cv::Mat frame = make_colour_frame(60 + 4 * i, 90 + 6 * i, 250 - 3 * i, 150 - 5 * i, 25);
+    process_frame(vision, frame, c, hands);
+    if (i == 0) {
+      allocations = frame_pool_allocations();
+    }
+    assert(frame_pool_allocations() == allocations);
+  }
+
+  // Released images are handed out again rather than made afresh.
+  free_vision(vision);
+  vision = init_vision(3, 0.5);
+  prepare_vision(vision, TEST_HEIGHT, TEST_WIDTH, CV_8UC3);
+  assert(frame_pool_allocations() == allocations);
+
+  free(hands);
+  free_vision(vision);
+  free_calibration(c);
+}
+
+void test_frame_pool_alignment(void) {
+  printf("frame_pool_alignment\n");
+  calibration_t *c = make_test_calibration();
+
+  // An odd width, so the pooled rows are padded out past the pixels.
+  cv::Mat colour = make_colour_frame(30, 60, 70, 60, 20)(cv::Rect(0, 0, 101, 120));
+  cv::Mat frame = acquire_mat(colour.rows, colour.cols, CV_8UC3);
+  cv::Mat mask = acquire_mat(colour.rows, colour.cols, CV_8UC1);
+  assert((uintptr_t) frame.data % FRAME_ALIGN == 0 && frame.step % FRAME_ALIGN == 0);
+  assert((uintptr_t) mask.data % FRAME_ALIGN == 0 && mask.step % FRAME_ALIGN == 0);
+  colour.copyTo(frame);
+
+  // Only the view of the region is written, straight into the pooled mask.
+  cv::Mat expected = get_arm_bgr(colour, c);
+  cv::Rect region(13, 7, 61, 90);
+  mask.setTo(cv::Scalar(1));
+  threshold_region(frame, c, mask, region);
+  for (int y = 0; y < mask.rows; y++) {
+    for (int x = 0; x < mask.cols; x++) {
+      bool inside = x >= region.x && x < region.x + region.width && y >= region.y && y < region.y + region.height;
+      assert(mask.at<unsigned char>(y, x) == (inside ? expected.at<unsigned char>(y, x) : 1));
+    }
+  }
+
+  release_mat(&frame);
+  release_mat(&mask);
+  assert(frame.empty() && mask.empty());
+  free_calibration(c);
+}
+
+void test_raw_video_round_trip(void) {
+  printf("raw_video_round_trip\n");
+  for (int format = raw_bgr; format <= raw_yuyv; format++) {
+    char path[] = "/tmp/raw_video_testXXXXXX.raw";
+    close(mkstemps(path, 4));
+    raw_video_writer_t *w = open_raw_writer(path, 320, 240, (raw_format_t) format, 25);
+    for (int i = 0; i < 3; i++) {
+      write_raw_frame(w, make_colour_frame(60 + 10 * i, 90, 250, 150 - 10 * i, 25));
+    }
+    close_raw_writer(w, 0);
+
+    frame_source_t *s = open_frame_source(path, false);
+    assert(s->type == source_raw && s->raw->header->frame_count == 3 && s->fps == 25);
+    for (int i = 0; i < 3; i++) {
+      cv::Mat expected = make_colour_frame(60 + 10 * i, 90, 250, 150 - 10 * i, 25);
+      cv::Mat frame = read_frame(s);
+      assert(frame.rows == 240 && frame.cols == 320 && frame.type() == CV_8UC3);
+      if (format == raw_bgr) {
+        // Handed out from inside the mapping, on an aligned frame boundary.
+        assert(frame.data >= s->raw->mapping && frame.data < s->raw->mapping + s->raw->length);
+        assert((uintptr_t) frame.data % FRAME_ALIGN == 0);
+      }
+      // YUYV shares chroma between pairs of pixels, so only the flat areas come back closely.
+      for (int y = 0; y < frame.rows; y++) {
+        for (int x = 2; x < frame.cols - 2; x++) {
+          const unsigned char *p = frame.ptr<unsigned char>(y) + 3 * x;
+          const unsigned char *q = expected.ptr<unsigned char>(y) + 3 * x;
+          bool flat = memcmp(q - 6, q, 3) == 0 && memcmp(q + 6, q, 3) == 0;
+          for (int ch = 0; ch < 3; ch++) {
+            assert(format == raw_bgr ? p[ch] == q[ch] : !flat || abs(p[ch] - q[ch]) <= 4);
+          }
+        }
+      }
+    }
+    assert(read_frame(s).empty() && s->finished);
+    close_frame_source(s);
+    unlink(path);
+  }
+}
+
+/**
+ * @brief Checks that opening a source exits with a failure, in a child process.
+ */
+bool open_fails(const char *name) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    // The error message is expected, so keep it out of the test output.
+    dup2(open("/dev/null", O_WRONLY), STDERR_FILENO);
+    close_frame_source(open_frame_source(name, false));
+    _exit(EXIT_SUCCESS);
+  }
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+void test_image_directory_source(void) {
+  printf("image_directory_source\n");
+  char directory[] = "/tmp/frame_source_testXXXXXX";
+  assert(mkdtemp(directory));
+
+  // Written out of order, with a file that is not an image among them.
+  const char *names[] = {"frame_2.png", "frame_0.png", "notes.txt", "frame_1.png"};
+  int order[] = {2, 0, -1, 1};
+  char path[PATH_MAX];
+  for (int i = 0; i < 4; i++) {
+    snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+    if (order[i] < 0) {
+      fclose(fopen(path, "w"));
+    } else {
+      assert(cv::imwrite(path, make_colour_frame(60 + 10 * order[i], 90, 250, 150 - 10 * order[i], 25)));
+    }
+  }
+
+  frame_source_t *s = open_frame_source(directory, false);
+  assert(s->type == source_images && s->name_count == 3 && !s->realtime && !s->stable);
+  for (int i = 0; i < 3; i++) {
+    assert(!s->finished);
+    cv::Mat expected = make_colour_frame(60 + 10 * i, 90, 250, 150 - 10 * i, 25);
+    cv::Mat frame = read_frame(s);
+    assert(frame.rows == TEST_HEIGHT && frame.cols == TEST_WIDTH && frame.type() == CV_8UC3);
+    for (int y = 0; y < frame.rows; y++) {
+      assert(memcmp(frame.ptr<unsigned char>(y), expected.ptr<unsigned char>(y), 3 * TEST_WIDTH) == 0);
+    }
+  }
+  assert(read_frame(s).empty() && s->finished);
+  assert(read_frame(s).empty());
+  close_frame_source(s);
+
+  for (int i = 0; i < 4; i++) {
+    snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+    unlink(path);
+  }
+  // Now empty, and then gone.
+  assert(open_fails(directory));
+  rmdir(directory);
+  snprintf(path, sizeof(path), "%s/", directory);
+  assert(open_fails(path));
+}
+
+int main(int argc, char **argv) {
+  printf("Running tests:\n");
+  run_test(test_force_point_matches_sum);
+  run_test(test_force_point_detect_hands);
+  run_test(test_field_matches_sum);
+  run_test(test_field_detect_hands);
+  run_test(test_pyramid_detect_hands);
+  run_test(test_mass_tables);
+  run_test(test_centroid_detect_hands);
+  run_test(test_denoise_region);
+  run_test(test_roi_detect_hands);
+  run_test(test_scaled_detect_hands);
+  run_test(test_thread_pool_matches_serial);
+  run_test(test_frame_pool_steady_state);
+  run_test(test_frame_pool_alignment);
+  run_test(test_raw_video_round_trip);
+  run_test(test_image_directory_source);
+  printf("All passed!\n");
+  return EXIT_SUCCESS;
+}
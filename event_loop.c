@@ -0,0 +1,199 @@
+/**
+ * @file event_loop.c
+ * @brief Waits on keyboard input, new hand positions and the game timer at once.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/**
+ * @brief The sources that can wake the game loop, or'd together by wait_events.
+ */
+typedef enum {
+  /** There are keys to read from the terminal. */
+  event_input = 1,
+  /** The vision thread has published new hand positions. */
+  event_hands = 2,
+  /** The deadline passed to wait_events has been reached. */
+  event_timer = 4,
+} event_t;
+
+/**
+ * @brief A struct that holds the file descriptors the game loop sleeps on.
+ */
+typedef struct {
+  /** The epoll instance watching the other descriptors. */
+  int epoll_fd;
+  /** A CLOCK_MONOTONIC timerfd armed for each wait's deadline. */
+  int timer_fd;
+  /** The terminal the keys are read from, -1 if it is not being watched. */
+  int input_fd;
+  /** An eventfd the vision thread signals whenever it publishes. */
+  int hands_fd;
+} event_loop_t;
+
+/**
+ * @brief Makes a non-blocking eventfd for one thread to wake another with.
+ * @returns The eventfd.
+ */
+int make_notifier(void) {
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd == -1) {
+    perror("Unable to create eventfd");
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+/**
+ * @brief Wakes whatever is waiting on an eventfd.
+ * Signals that arrive before the waiter wakes are merged into one.
+ * @param fd The eventfd from make_notifier.
+ */
+void notify(int fd) {
+  uint64_t one = 1;
+  if (write(fd, &one, sizeof(one)) == -1) {
+    // Only fails if the counter would overflow, when the waiter is already due to wake.
+  }
+}
+
+/**
+ * @brief Clears an eventfd or timerfd after it has woken a waiter.
+ * @param fd The descriptor to clear.
+ */
+void drain_notifier(int fd) {
+  uint64_t count;
+  if (read(fd, &count, sizeof(count)) == -1) {
+    // Nothing to clear, it was already read.
+  }
+}
+
+/**
+ * @brief Sleeps until an eventfd is signalled, then clears it.
+ * @param fd The eventfd from make_notifier.
+ */
+void wait_notifier(int fd) {
+  struct pollfd p = {fd, POLLIN, 0};
+  if (poll(&p, 1, -1) > 0) {
+    drain_notifier(fd);
+  }
+}
+
+/**
+ * @brief Adds a descriptor for an epoll instance to watch for reading.
+ * @param epoll_fd The epoll instance.
+ * @param fd The descriptor to watch.
+ * @param event The event_t it stands for.
+ * @returns False if the descriptor cannot be watched, such as a regular file
+ *          or /dev/null, which are always ready.
+ */
+bool watch_fd(int epoll_fd, int fd, event_t event) {
+  struct epoll_event e;
+  e.events = EPOLLIN;
+  e.data.u32 = event;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &e) == -1) {
+    if (errno == EPERM) {
+      return false;
+    }
+    perror("Unable to watch file descriptor");
+    exit(EXIT_FAILURE);
+  }
+  return true;
+}
+
+/**
+ * @brief Initialises the event_loop_t struct.
+ * Input is only watched when it is a terminal, so the games also run with
+ * stdin redirected from a file, /dev/null or a pipe.
+ * @param input_fd The terminal to read keys from.
+ * @param hands_fd The eventfd the vision thread signals.
+ * @returns A pointer to the new event_loop_t struct.
+ */
+event_loop_t *init_event_loop(int input_fd, int hands_fd) {
+  event_loop_t *l = (event_loop_t *) malloc(sizeof(event_loop_t));
+  l->input_fd = input_fd;
+  l->hands_fd = hands_fd;
+  l->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  l->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (l->epoll_fd == -1 || l->timer_fd == -1) {
+    perror("Unable to create event loop");
+    exit(EXIT_FAILURE);
+  }
+
+  if (!isatty(input_fd) || !watch_fd(l->epoll_fd, input_fd, event_input)) {
+    l->input_fd = -1;
+  }
+  watch_fd(l->epoll_fd, hands_fd, event_hands);
+  watch_fd(l->epoll_fd, l->timer_fd, event_timer);
+  return l;
+}
+
+/**
+ * @brief Sleeps until there is input, new hands, or the deadline has passed.
+ * The timer is armed for the exact deadline rather than rounded to the
+ * millisecond epoll timeout, so game updates are not late. The hands and
+ * timer notifications are cleared, but the input must be read by the caller
+ * or the next wait returns straight away.
+ * @param l The event loop.
+ * @param deadline The CLOCK_MONOTONIC time to wake by, in seconds.
+ * @returns The event_t sources that are ready, or'd together.
+ */
+int wait_events(event_loop_t *l, double deadline) {
+  struct itimerspec timer = {};
+  timer.it_value.tv_sec = (time_t) deadline;
+  timer.it_value.tv_nsec = (long) ((deadline - (time_t) deadline) * 1e9);
+  // A zero time would disarm the timer instead.
+  if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0) {
+    timer.it_value.tv_nsec = 1;
+  }
+  timerfd_settime(l->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+
+  struct epoll_event events[3];
+  int n;
+  do {
+    n = epoll_wait(l->epoll_fd, events, 3, -1);
+  } while (n == -1 && errno == EINTR);
+
+  int ready = 0;
+  for (int i = 0; i < n; i++) {
+    // A hung up terminal would wake every wait with nothing to read, so it is dropped.
+    if (events[i].data.u32 == event_input && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+      epoll_ctl(l->epoll_fd, EPOLL_CTL_DEL, l->input_fd, NULL);
+      l->input_fd = -1;
+      continue;
+    }
+    ready |= events[i].data.u32;
+  }
+  if (ready & event_hands) {
+    drain_notifier(l->hands_fd);
+  }
+  if (ready & event_timer) {
+    drain_notifier(l->timer_fd);
+  }
+  return ready;
+}
+
+/**
+ * @brief Frees the event_loop_t struct and the descriptors it made.
+ * The input and hands descriptors are left for their owners to close.
+ * @param l The event loop to free.
+ */
+void free_event_loop(event_loop_t *l) {
+  close(l->timer_fd);
+  close(l->epoll_fd);
+  free(l);
+}
+
+/**
+ * @brief Checks whether there is a display for HighGUI windows.
+ * @returns False when running headless, such as over ssh or on a build machine.
+ */
+bool has_display(void) {
+  return getenv("DISPLAY") || getenv("WAYLAND_DISPLAY");
+}
@@ -0,0 +1,112 @@
+/**
+ * @file filter.c
+ * @brief Functions to clean up the black and white skin frame.
+ */
+
+/** Radius of the majority filter, giving the 11x11 window of the old median. */
+#define DENOISE_RADIUS 5
+
+/**
+ * @brief Clamps a coordinate to lie inside an image, replicating the border.
+ * @param i The coordinate.
+ * @param size The width or height of the image.
+ * @returns The nearest coordinate that is inside the image.
+ */
+int clamp_coord(int i, int size) {
+  return i < 0 ? 0 : i >= size ? size - 1 : i;
+}
+
+/**
+ * @brief The arguments of denoise_band.
+ */
+typedef struct {
+  /** The black and white frame. */
+  cv::Mat src;
+  /** Where to write the filtered pixels. */
+  cv::Mat dst;
+  /** The distance from the centre of the window to its edge. */
+  int radius;
+  /** The part of dst to write. */
+  cv::Rect region;
+} denoise_args_t;
+
+/**
+ * @brief Filters a band of rows of a region, see denoise_region.
+ * Each band starts its own column counts, so bands are independent.
+ */
+void denoise_band(int start, int end, int band, void *arg) {
+  denoise_args_t *a = (denoise_args_t *) arg;
+  const cv::Mat &src = a->src;
+  cv::Rect region = a->region;
+  int radius = a->radius;
+  int width = src.cols;
+  int height = src.rows;
+  int majority = (2 * radius + 1) * (2 * radius + 1) / 2;
+  int span = region.width + 2 * radius;
+  int *col = (int *) band_scratch(band, sizeof(int) * 2 * span);
+  int *col_x = col + span;
+  int y_start = region.y + start;
+  int y_end = region.y + end;
+
+  // White pixel counts of each column over the window around the first row,
+  // where col[i] is the column region.x - radius + i clamped to the frame.
+  for (int i = 0; i < span; i++) {
+    col_x[i] = clamp_coord(region.x - radius + i, width);
+    col[i] = 0;
+    for (int y = y_start - radius; y <= y_start + radius; y++) {
+      col[i] += src.ptr<unsigned char>(clamp_coord(y, height))[col_x[i]] != 0;
+    }
+  }
+
+  for (int y = y_start; y < y_end; y++) {
+    unsigned char *out = a->dst.ptr<unsigned char>(y) + region.x;
+
+    int count = 0;
+    for (int i = 0; i <= 2 * radius; i++) {
+      count += col[i];
+    }
+    for (int x = 0; x < region.width; x++) {
+      out[x] = count > majority ? 255 : 0;
+      if (x + 1 < region.width) {
+        count += col[x + 2 * radius + 1] - col[x];
+      }
+    }
+
+    // Slide the column counts down a row.
+    if (y + 1 < y_end) {
+      const unsigned char *add = src.ptr<unsigned char>(clamp_coord(y + radius + 1, height));
+      const unsigned char *sub = src.ptr<unsigned char>(clamp_coord(y - radius, height));
+      for (int i = 0; i < span; i++) {
+        col[i] += (add[col_x[i]] != 0) - (sub[col_x[i]] != 0);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Removes speckles from part of a black and white frame by majority vote.
+ * A pixel becomes white iff most of the (2 * radius + 1) squared pixels
+ * around it are white. For a frame that is only 0 and 255 this is exactly
+ * what a median blur of the same size gives, including the replicated
+ * border, but it keeps running column counts so each pixel costs the same
+ * whatever the radius. Only src within radius of the region is read. The rows
+ * are split into bands on the thread pool.
+ * @param src The black and white frame.
+ * @param dst Where to write the filtered pixels, must not share memory with src.
+ * @param radius The distance from the centre of the window to its edge.
+ * @param region The part of dst to write, must lie inside the frame.
+ */
+void denoise_region(const cv::Mat &src, cv::Mat &dst, int radius, cv::Rect region) {
+  denoise_args_t a = {src, dst, radius, region};
+  run_bands(region.height, band_count(region.height, MIN_BAND_ROWS), denoise_band, &a);
+}
+
+/**
+ * @brief Removes speckles from a whole black and white frame by majority vote.
+ * @param src The black and white frame.
+ * @param dst Where to write the filtered frame, must not share memory with src.
+ * @param radius The distance from the centre of the window to its edge.
+ */
+void denoise_mask(const cv::Mat &src, cv::Mat &dst, int radius) {
+  denoise_region(src, dst, radius, cv::Rect(0, 0, src.cols, src.rows));
+}
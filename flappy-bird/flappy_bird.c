@@ -136,7 +136,7 @@ object_list_t *init_game(void) {
   for_all(objects, print_object);
 
   cbreak();
-  initscr();
+  init_screen();
   noecho();
   timeout(50);
   setlocale(LC_ALL, "");
@@ -158,9 +158,8 @@ object_list_t *init_game(void) {
  * @param list The object list.
  */
 void render_game(object_list_t *list) {
-  clear();
+  move(0, 0);
   for_all(list, move_object);
   for_all(list, move_pipes);
   print_game(list, WIDTH, HEIGHT);
-  refresh();
 }
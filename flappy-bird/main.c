@@ -26,6 +26,7 @@ int main(int argc, char **argv) {
   endwin();
   printf("\nYou died!!!!\n");
   for_all(objects, print_object);
+  print_presenter_stats(objects->presenter);
   free_object_list(objects);
   return EXIT_SUCCESS;
 }
@@ -36,6 +36,7 @@ int main(void) {
   endwin();
   printf("\nYou died!!!!\n");
   for_all(objects, print_object);
+  print_presenter_stats(objects->presenter);
   free_object_list(objects);
   return EXIT_SUCCESS;
 }
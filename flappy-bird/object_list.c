@@ -2,6 +2,8 @@
  * @file object_list.c
  * @brief Functions for using object list.
  */
+#include <assert.h>
+#include <string.h>
 #include "object_list.h"
 
 /**
@@ -10,40 +12,116 @@
  * @returns Initialised object list.
  */
 object_list_t *new_list(void) {
-  object_list_t *list = malloc(sizeof(object_list_t));
+  object_list_t *list = (object_list_t *) malloc(sizeof(object_list_t));
   if (!list) {
     perror("Unable to allocate memory for new list");
     exit(EXIT_FAILURE);
   }
-  list->array = malloc(sizeof(object_list_elem_t *) * INITIAL_OBJECT_LIST_SIZE);
-  if (!list->array) {
+  list->array = (object_list_elem_t **) malloc(sizeof(object_list_elem_t *) * INITIAL_OBJECT_LIST_SIZE);
+  list->draw_order = (object_list_elem_t **) malloc(sizeof(object_list_elem_t *) * INITIAL_OBJECT_LIST_SIZE);
+  if (!list->array || !list->draw_order) {
     perror("Unable to allocate memory for new list");
     exit(EXIT_FAILURE);
   }
   list->size = 0;
   list->max_size = INITIAL_OBJECT_LIST_SIZE;
+  list->presenter = NULL;
   return list;
 }
 
+/**
+ * @brief Returns where an object goes in the draw order.
+ *
+ * @param list Object list, with elem not in its draw order.
+ * @param count Number of objects in the draw order.
+ * @param elem Object to place.
+ * @returns Index after the last object no deeper than elem.
+ */
+static int find_draw_index(object_list_t *list, int count, object_list_elem_t *elem) {
+  int low = 0;
+  int high = count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (compare_list_elem(&list->draw_order[middle], &elem) <= 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
 /**
  * @brief Adds a element to an object list.
  *
+ * The element is also inserted into the draw order by its depth, so the list
+ * never needs sorting when it is drawn.
  * @param list Object list to add element to.
  * @param elem Object list elem to add to the list.
  */
 void add_elem(object_list_t *list, object_list_elem_t *elem) {
   if (list->size >= list->max_size) {
     list->max_size *= 2;
-    list->array = realloc(list->array, sizeof(object_list_elem_t *) * list->max_size);
-    if (!list->array) {
+    list->array = (object_list_elem_t **) realloc(list->array, sizeof(object_list_elem_t *) * list->max_size);
+    list->draw_order = (object_list_elem_t **) realloc(list->draw_order, sizeof(object_list_elem_t *) * list->max_size);
+    if (!list->array || !list->draw_order) {
       perror("Unable to reallocate memory for object list");
       exit(EXIT_FAILURE);
     }
   }
   list->array[list->size] = elem;
+  int index = find_draw_index(list, list->size, elem);
+  memmove(list->draw_order + index + 1, list->draw_order + index, sizeof(object_list_elem_t *) * (list->size - index));
+  list->draw_order[index] = elem;
   list->size++;
 }
 
+/**
+ * @brief Changes the depth of an object in a list, moving it in the draw order.
+ *
+ * Depths must only be changed with this once an object is in a list.
+ * @param list Object list the element is in, which it must be.
+ * @param elem Object to change.
+ * @param depth New depth.
+ */
+void set_depth(object_list_t *list, object_list_elem_t *elem, uint16_t depth) {
+  int index = 0;
+  while (index < list->size && list->draw_order[index] != elem) {
+    index++;
+  }
+  assert(index < list->size);
+  if (index == list->size) {
+    // Not in the list, so there is no draw order to keep.
+    elem->depth = depth;
+    return;
+  }
+  memmove(list->draw_order + index, list->draw_order + index + 1, sizeof(object_list_elem_t *) * (list->size - index - 1));
+  elem->depth = depth;
+  index = find_draw_index(list, list->size - 1, elem);
+  memmove(list->draw_order + index + 1, list->draw_order + index, sizeof(object_list_elem_t *) * (list->size - 1 - index));
+  list->draw_order[index] = elem;
+}
+
+/**
+ * @brief Compares two objects by depth, for qsort over an array of object pointers.
+ *
+ * @param a Pointer to the first object.
+ * @param b Pointer to the second object.
+ * @returns Negative if a is shallower, 0 if level, positive if deeper.
+ */
+int compare_list_elem(const void *a, const void *b) {
+  object_list_elem_t *object_a = *(object_list_elem_t * const *) a;
+  object_list_elem_t *object_b = *(object_list_elem_t * const *) b;
+
+  if (object_a->depth == object_b->depth) {
+    return 0;
+  } else if (object_a->depth < object_b->depth) {
+    return -1;
+  } else {
+    return 1;
+  }
+}
+
 /**
  * @brief Returns if the object is covering the point.
  *
@@ -72,7 +150,7 @@ char get_char_ascii(ascii_t *ascii, vector_t point) {
 }
 
 /**
- * @brief Returns the char at a given position.
+ * @brief Returns the char at a given position, from the shallowest object there.
  *
  * @param list Object list.
  * @param point Position of the char.
@@ -80,10 +158,10 @@ char get_char_ascii(ascii_t *ascii, vector_t point) {
  */
 char get_char_list(object_list_t *list, vector_t point) {
   for (int i = 0; i < list->size; i++) {
-    if (is_covering(list->array[i], point)) {
-      point.x -= list->array[i]->point.x;
-      point.y -= list->array[i]->point.y;
-      return get_char_ascii(list->array[i]->ascii, point);
+    if (is_covering(list->draw_order[i], point)) {
+      point.x -= list->draw_order[i]->point.x;
+      point.y -= list->draw_order[i]->point.y;
+      return get_char_ascii(list->draw_order[i]->ascii, point);
     }
   }
   return EMPTY_SPACE;
@@ -146,7 +224,7 @@ object_list_elem_t *get_elem(object_list_t *list, type_t type) {
 }
 
 /**
- * @brief Returns the colour for a paticular position.
+ * @brief Returns the colour for a paticular position, from the shallowest object there.
  *
  * @param list The current game state.
  * @param point The position to return the colour of.
@@ -154,34 +232,79 @@ object_list_elem_t *get_elem(object_list_t *list, type_t type) {
  */
 int get_color(object_list_t *list, vector_t point) {
   for (int i = 0; i < list->size; i++) {
-    if (is_covering(list->array[i], point)) {
-      return list->array[i]->ascii->color;
+    if (is_covering(list->draw_order[i], point)) {
+      return list->draw_order[i]->ascii->color;
     }
   }
   return 1;
 }
 
 /**
- * @brief Prints the game.
+ * @brief Draws an object's ascii art over a framebuffer.
+ *
+ * Only the part of the object on the screen is touched, so the cost is the
+ * area drawn.
+ * @param framebuffer Framebuffer to draw into.
+ * @param elem Object to draw.
+ */
+void draw_elem(framebuffer_t *framebuffer, object_list_elem_t *elem) {
+  ascii_t *ascii = elem->ascii;
+  int left = elem->point.x < 0 ? 0 : elem->point.x;
+  int top = elem->point.y < 0 ? 0 : elem->point.y;
+  int right = elem->point.x + ascii->width;
+  int bottom = elem->point.y + ascii->height;
+  right = right > framebuffer->width ? framebuffer->width : right;
+  bottom = bottom > framebuffer->height ? framebuffer->height : bottom;
+  if (left >= right) {
+    return;
+  }
+
+  for (int y = top; y < bottom; y++) {
+    int offset = y * framebuffer->width;
+    memcpy(framebuffer->chars + offset + left,
+           ascii->ascii + (y - elem->point.y) * ascii->width + (left - elem->point.x), right - left);
+    for (int x = left; x < right; x++) {
+      framebuffer->colors[offset + x] = ascii->color;
+    }
+  }
+}
+
+/**
+ * @brief Renders the game into a framebuffer.
  *
+ * The objects are drawn from the deepest to the shallowest, following the
+ * draw order, so each cell ends up as get_char_list and get_color would give
+ * it: from the shallowest object covering it.
+ * @param list The current game state.
+ * @param framebuffer Framebuffer to render into.
+ */
+void rasterize(object_list_t *list, framebuffer_t *framebuffer) {
+  int cells = framebuffer->width * framebuffer->height;
+  memset(framebuffer->chars, EMPTY_SPACE, cells);
+  for (int i = 0; i < cells; i++) {
+    framebuffer->colors[i] = 1;
+  }
+  for (int i = list->size - 1; i >= 0; i--) {
+    draw_elem(framebuffer, list->draw_order[i]);
+  }
+}
+
+/**
+ * @brief Prints the game, from the cursor's row, and refreshes the screen.
+ *
+ * Only what changed since the last call is sent to the terminal.
  * @param list The current game state.
  * @param width Width of the screen being used.
  * @param height Height of the screen being used.
  */
 void print_game(object_list_t *list, int width, int height) {
-  for (int i = 0; i < height; i++) {
-    for (int j = 0; j < width; j++) {
-      vector_t point = {j, i};
-      int color = get_color(list, point);
-      char c = get_char_list(list, point);
-      if (c == ' ') {
-        color*=2;
-      }
-      attron(COLOR_PAIR(color));
-      addch(c);
-    }
-    printw("\n");
+  presenter_t *presenter = list->presenter;
+  if (!presenter || presenter->back->width != width || presenter->back->height != height) {
+    free_presenter(presenter);
+    presenter = list->presenter = new_presenter(width, height);
   }
+  rasterize(list, presenter->back);
+  present(presenter, getcury(stdscr));
 }
 
 /**
@@ -191,7 +314,9 @@ void print_game(object_list_t *list, int width, int height) {
  */
 void free_object_list(object_list_t *list) {
   for_all(list, free_object_list_elem);
+  free_presenter(list->presenter);
   free(list->array);
+  free(list->draw_order);
   free(list);
 }
 
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <ncurses.h>
 #include "ascii_art.h"
+#include "screen.h"
 
 /** Initial size of the object list array. */
 #define INITIAL_OBJECT_LIST_SIZE 20
@@ -33,6 +34,12 @@ typedef enum {
   snake_tail,
   /** Snake Apple. */
   snake_apple,
+  /** Pong Ball. */
+  pong_ball,
+  /** Pong Left Paddle. */
+  pong_paddle_left,
+  /** Pong Right Paddle. */
+  pong_paddle_right,
 } type_t;
 
 /**
@@ -75,6 +82,10 @@ typedef struct {
   uint16_t size;
   /** Size currently allocated for the array. */
   uint16_t max_size;
+  /** The objects from the shallowest, drawn in front, to the deepest, ties in the order they were added. */
+  object_list_elem_t **draw_order;
+  /** Presents the list to the terminal, made on first use. */
+  presenter_t *presenter;
 } object_list_t;
 
 /** A function that can be applied to all of the list.*/
@@ -82,6 +93,7 @@ typedef void object_list_elem_function_t(object_list_elem_t *);
 
 object_list_t *new_list(void);
 void add_elem(object_list_t *list, object_list_elem_t *elem);
+void set_depth(object_list_t *list, object_list_elem_t *elem, uint16_t depth);
 int is_covering (object_list_elem_t *elem, vector_t point);
 char get_char_ascii(ascii_t *ascii, vector_t point);
 char get_char_list(object_list_t *list, vector_t point);
@@ -89,9 +101,12 @@ void for_all(object_list_t *list, object_list_elem_function_t function);
 void move_object(object_list_elem_t *elem);
 void print_object(object_list_elem_t *elem);
 int get_color(object_list_t *list, vector_t point);
+void draw_elem(framebuffer_t *framebuffer, object_list_elem_t *elem);
+void rasterize(object_list_t *list, framebuffer_t *framebuffer);
 void print_game(object_list_t *list, int width, int height);
 void free_object_list(object_list_t *list);
 void free_object_list_elem(object_list_elem_t *elem);
 object_list_elem_t *get_elem(object_list_t *list, type_t type);
+int compare_list_elem(const void *a, const void *b);
 
 #endif
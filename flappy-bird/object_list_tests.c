@@ -1,5 +1,6 @@
 #include "object_list.h"
 #include <assert.h>
+#include <string.h>
 
 typedef void test_t(void);
 
@@ -15,75 +16,75 @@ void test_add(void) {
   assert(list);
   assert(list->size == 0);
   assert(list->max_size == INITIAL_OBJECT_LIST_SIZE);
-  object_list_elem_t *elem = malloc(sizeof(object_list_elem_t));
+  object_list_elem_t *elem = calloc(1, sizeof(object_list_elem_t));
   elem->type = bird;
   add_elem(list, elem);
   assert(list->size == 1);
   assert(list->array[0]->type == bird);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   elem->type = snake_head;
   add_elem(list, elem);
   assert(list->size == 2);
   assert(list->array[1]->type == snake_head);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 3);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 4);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 5);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 6);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 7);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 8);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 9);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 10);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 11);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 12);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 13);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 14);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 15);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 16);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 17);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 18);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 19);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 20);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 21);
   assert(list->max_size = 2 * INITIAL_OBJECT_LIST_SIZE);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   add_elem(list, elem);
   assert(list->size == 22);
   // free_object_list(list);
@@ -94,32 +95,284 @@ void test_get_elem(void) {
   object_list_t *list = new_list();
   assert(list);
   assert(list->size == 0);
-  object_list_elem_t *elem = malloc(sizeof(object_list_elem_t));
+  object_list_elem_t *elem = calloc(1, sizeof(object_list_elem_t));
   elem->type = bird;
   add_elem(list, elem);
   assert(elem == get_elem(list, bird));
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   elem->type = snake_head;
   add_elem(list, elem);
   assert(elem == get_elem(list, snake_head));
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   elem->type = snake_tail;
   add_elem(list, elem);
   assert(elem == get_elem(list, snake_tail));
   elem = get_elem(list, bird);
   assert(elem->type == bird);
-  elem = malloc(sizeof(object_list_elem_t));
+  elem = calloc(1, sizeof(object_list_elem_t));
   elem->type = snake_apple;
   add_elem(list, elem);
   assert(elem == get_elem(list, snake_apple));
   free_object_list(list);
 }
 
+void test_rasterize(void) {
+  printf("rasterize\n");
+  srand(1);
+  object_list_t *list = new_list();
+  // Overlapping sprites, some hanging off each edge of the screen.
+  for (int i = 0; i < 30; i++) {
+    object_list_elem_t *elem = calloc(1, sizeof(object_list_elem_t));
+    elem->ascii = malloc(sizeof(ascii_t));
+    elem->ascii->width = 1 + rand() % 12;
+    elem->ascii->height = 1 + rand() % 8;
+    elem->ascii->color = 1 + rand() % 4;
+    elem->ascii->ascii = malloc(elem->ascii->width * elem->ascii->height);
+    for (int j = 0; j < elem->ascii->width * elem->ascii->height; j++) {
+      elem->ascii->ascii[j] = "# @/\\|"[rand() % 6];
+    }
+    elem->point = (vector_t) {.x = rand() % 50 - 10, .y = rand() % 30 - 8};
+    elem->depth = rand() % 4;
+    add_elem(list, elem);
+  }
+
+  framebuffer_t *framebuffer = new_framebuffer(40, 20);
+  rasterize(list, framebuffer);
+  for (int y = 0; y < framebuffer->height; y++) {
+    for (int x = 0; x < framebuffer->width; x++) {
+      vector_t point = {x, y};
+      assert(framebuffer->chars[y * framebuffer->width + x] == get_char_list(list, point));
+      assert(framebuffer->colors[y * framebuffer->width + x] == get_color(list, point));
+    }
+  }
+  free_framebuffer(framebuffer);
+  for (int i = 0; i < list->size; i++) {
+    free(list->array[i]->ascii->ascii);
+  }
+  free_object_list(list);
+}
+
+void test_depth_order(void) {
+  printf("depth order\n");
+  object_list_t *list = new_list();
+  uint16_t depths[] = {3, 1, 2, 1, 0, 3, 2};
+  object_list_elem_t *elems[7];
+  for (int i = 0; i < 7; i++) {
+    elems[i] = calloc(1, sizeof(object_list_elem_t));
+    elems[i]->depth = depths[i];
+    add_elem(list, elems[i]);
+  }
+  // Shallowest first, and level objects in the order they were added.
+  object_list_elem_t *expected[] = {elems[4], elems[1], elems[3], elems[2], elems[6], elems[0], elems[5]};
+  for (int i = 0; i < 7; i++) {
+    assert(list->array[i] == elems[i]);
+    assert(list->draw_order[i] == expected[i]);
+  }
+
+  set_depth(list, elems[0], 1);
+  object_list_elem_t *deeper[] = {elems[4], elems[1], elems[3], elems[0], elems[2], elems[6], elems[5]};
+  for (int i = 0; i < 7; i++) {
+    assert(list->draw_order[i] == deeper[i]);
+  }
+  set_depth(list, elems[5], 0);
+  assert(list->draw_order[0] == elems[4]);
+  assert(list->draw_order[1] == elems[5]);
+  assert(list->array[5] == elems[5]);
+  free_object_list(list);
+}
+
+void test_find_changed_run(void) {
+  printf("find_changed_run\n");
+  presenter_t *presenter = new_presenter(20, 2);
+  int cells = 20 * 2;
+  memset(presenter->back->chars, 'a', cells);
+  for (int i = 0; i < cells; i++) {
+    presenter->back->colors[i] = 1;
+  }
+
+  // Nothing is on the terminal yet, so every row is one run.
+  int end;
+  assert(find_changed_run(presenter, 1, 0, &end) == 0 && end == 20);
+
+  memcpy(presenter->front->chars, presenter->back->chars, cells);
+  memcpy(presenter->front->colors, presenter->back->colors, sizeof(int) * cells);
+  presenter->drawn = 1;
+  assert(find_changed_run(presenter, 0, 0, &end) == -1);
+
+  // Short gaps are joined, long ones split the run.
+  presenter->back->chars[2] = 'b';
+  presenter->back->colors[5] = 2;
+  presenter->back->chars[15] = 'b';
+  assert(find_changed_run(presenter, 0, 0, &end) == 2 && end == 6);
+  assert(find_changed_run(presenter, 0, end, &end) == 15 && end == 16);
+  assert(find_changed_run(presenter, 0, end, &end) == -1);
+  assert(find_changed_run(presenter, 1, 0, &end) == -1);
+  free_presenter(presenter);
+}
+
+/** Width of the terminal modelled by replay_ansi. */
+#define TERMINAL_WIDTH 10
+/** Height of the terminal modelled by replay_ansi. */
+#define TERMINAL_HEIGHT 4
+
+/**
+ * @brief A terminal that understands the sequences encode_ansi writes.
+ */
+typedef struct {
+  char chars[TERMINAL_HEIGHT][TERMINAL_WIDTH];
+  int fg[TERMINAL_HEIGHT][TERMINAL_WIDTH];
+  int bg[TERMINAL_HEIGHT][TERMINAL_WIDTH];
+  int y;
+  int x;
+  int current_fg;
+  int current_bg;
+} terminal_t;
+
+int test_pair_colors(short pair, short *fg, short *bg) {
+  // Covers the default colour, -1, the bright colours, 8 to 15, and the rest of the 256.
+  *fg = pair % 3 == 0 ? pair * 13 : pair - 2;
+  *bg = pair % 3 == 1 ? pair * 14 : pair * 5 % 17 - 1;
+  return 0;
+}
+
+void replay_ansi(terminal_t *terminal, const char *in, const char *end) {
+  while (in < end) {
+    if (*in == '\x1b') {
+      assert(in[1] == '[');
+      int args[6] = {0, 0, 0, 0, 0, 0};
+      int count = 0;
+      for (in += 2; *in == ';' || (*in >= '0' && *in <= '9'); in++) {
+        if (*in == ';') {
+          count++;
+        } else {
+          args[count] = args[count] * 10 + *in - '0';
+        }
+      }
+      if (*in == 'H') {
+        terminal->y = (args[0] ? args[0] : 1) - 1;
+        terminal->x = (args[1] ? args[1] : 1) - 1;
+      } else if (*in == 'C') {
+        terminal->x += args[0] ? args[0] : 1;
+      } else {
+        assert(*in == 'm');
+        for (int i = 0; i <= count; i++) {
+          int n = args[i];
+          if (n == 39) {
+            terminal->current_fg = -1;
+          } else if (n == 49) {
+            terminal->current_bg = -1;
+          } else if (n >= 30 && n <= 37) {
+            terminal->current_fg = n - 30;
+          } else if (n >= 40 && n <= 47) {
+            terminal->current_bg = n - 40;
+          } else if (n == 38 || n == 48) {
+            assert(args[i + 1] == 5 && args[i + 2] >= 16 && args[i + 2] <= 255);
+            *(n == 38 ? &terminal->current_fg : &terminal->current_bg) = args[i + 2];
+            i += 2;
+          } else if (n >= 90 && n <= 97) {
+            terminal->current_fg = n - 82;
+          } else {
+            assert(n >= 100 && n <= 107);
+            terminal->current_bg = n - 92;
+          }
+        }
+      }
+    } else if (*in == '\r') {
+      terminal->x = 0;
+    } else {
+      // Writing past the last column wraps, as terminals do.
+      if (terminal->x >= TERMINAL_WIDTH) {
+        terminal->x = 0;
+        terminal->y++;
+      }
+      assert(terminal->y < TERMINAL_HEIGHT);
+      terminal->chars[terminal->y][terminal->x] = *in;
+      terminal->fg[terminal->y][terminal->x] = terminal->current_fg;
+      terminal->bg[terminal->y][terminal->x] = terminal->current_bg;
+      terminal->x++;
+    }
+    in++;
+  }
+}
+
+void assert_terminal_shows(terminal_t *terminal, framebuffer_t *framebuffer, int top) {
+  for (int y = 0; y < TERMINAL_HEIGHT; y++) {
+    for (int x = 0; x < TERMINAL_WIDTH; x++) {
+      if (y < top) {
+        assert(terminal->chars[y][x] == 0);
+        continue;
+      }
+      int i = (y - top) * framebuffer->width + x;
+      char c = framebuffer->chars[i];
+      short fg;
+      short bg;
+      test_pair_colors(c == ' ' ? framebuffer->colors[i] * 2 : framebuffer->colors[i], &fg, &bg);
+      assert(terminal->chars[y][x] == c);
+      assert(terminal->bg[y][x] == bg);
+      assert(c == ' ' || terminal->fg[y][x] == fg);
+    }
+  }
+}
+
+void test_encode_ansi(void) {
+  printf("encode_ansi\n");
+  srand(2);
+  // Wider than the terminal, and as tall as it, so it is drawn from row 1 with its last row cut off.
+  presenter_t *presenter = new_presenter(TERMINAL_WIDTH + 2, TERMINAL_HEIGHT);
+  framebuffer_t *back = presenter->back;
+  int cells = back->width * back->height;
+  for (int i = 0; i < cells; i++) {
+    back->chars[i] = "# @"[rand() % 3];
+    back->colors[i] = 1 + rand() % 8;
+  }
+  char *output = malloc(cells * 64 + 1);
+  terminal_t terminal;
+  memset(&terminal, 0, sizeof(terminal));
+  terminal.current_fg = -2;
+  terminal.current_bg = -2;
+
+  // The first frame is sent whole, from a cursor move to row 2, column 1, counted from 1.
+  char *end = encode_ansi(presenter, output, 1, TERMINAL_HEIGHT, TERMINAL_WIDTH, test_pair_colors);
+  *end = '\0';
+  assert(strncmp(output, "\x1b[2H", 4) == 0);
+  assert(strstr(output, "38;5;") != NULL && strstr(output, "48;5;") != NULL);
+  replay_ansi(&terminal, output, end);
+  assert_terminal_shows(&terminal, back, 1);
+
+  // Then only the changes: two runs in row 0, one off the edge, and one ending in the last column.
+  swap_frames(presenter);
+  memcpy(presenter->back->chars, presenter->front->chars, cells);
+  memcpy(presenter->back->colors, presenter->front->colors, sizeof(int) * cells);
+  back = presenter->back;
+  back->chars[1] = back->chars[1] == '#' ? '@' : '#';
+  back->chars[8] = back->chars[8] == '#' ? '@' : '#';
+  back->colors[11] = 9;
+  back->colors[back->width + TERMINAL_WIDTH - 1] = 9;
+  back->chars[2 * back->width] = back->chars[2 * back->width] == '#' ? '@' : '#';
+  end = encode_ansi(presenter, output, 1, TERMINAL_HEIGHT, TERMINAL_WIDTH, test_pair_colors);
+  *end = '\0';
+  assert(strncmp(output, "\x1b[2;2H", 6) == 0);
+  assert(strstr(output, "\x1b[6C") != NULL);
+  replay_ansi(&terminal, output, end);
+  assert_terminal_shows(&terminal, back, 1);
+
+  // Nothing changed, nothing sent.
+  swap_frames(presenter);
+  memcpy(presenter->back->chars, presenter->front->chars, cells);
+  memcpy(presenter->back->colors, presenter->front->colors, sizeof(int) * cells);
+  assert(encode_ansi(presenter, output, 1, TERMINAL_HEIGHT, TERMINAL_WIDTH, test_pair_colors) == output);
+  free(output);
+  free_presenter(presenter);
+}
 
 int main(int argc, char **argv) {
   printf("Running tests:\n");
   run_test(test_add);
   run_test(test_get_elem);
+  run_test(test_rasterize);
+  run_test(test_depth_order);
+  run_test(test_find_changed_run);
+  run_test(test_encode_ansi);
   printf("All passed!\n");
   return EXIT_SUCCESS;
 }
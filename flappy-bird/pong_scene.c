@@ -0,0 +1,95 @@
+/**
+ * @file pong_scene.c
+ * @brief The pong screen's objects, colours and status line.
+ *
+ * Included by pong.c and screen_benchmark.c, so the benchmark draws exactly
+ * what the game does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <ncurses.h>
+#include "object_list.h"
+#include "screen.h"
+
+/** Width of the pong screen. */
+#define PONG_WIDTH 400
+/** Height of the pong screen. */
+#define PONG_HEIGHT 150
+
+/** The pong ball. */
+static char pong_ball_ascii[] = "@";
+/** A pong paddle, 2 wide and 20 high. */
+static char pong_paddle_ascii[] = "||||||||||||||||||||||||||||||||||||||||";
+
+/**
+ * @brief Makes a pong object, still and white.
+ *
+ * @param type Type of the object.
+ * @param x Column of the object.
+ * @param y Row of the object.
+ * @param ascii The object's ascii art, width * height long.
+ * @param width Width of the ascii art.
+ * @param height Height of the ascii art.
+ * @returns The new object.
+ */
+object_list_elem_t *new_pong_elem(type_t type, int x, int y, char *ascii, int width, int height) {
+  object_list_elem_t *elem = (object_list_elem_t *) malloc(sizeof(object_list_elem_t));
+  ascii_t *art = (ascii_t *) malloc(sizeof(ascii_t));
+  if (!elem || !art) {
+    perror("Unable to allocate memory for pong");
+    exit(EXIT_FAILURE);
+  }
+  elem->ascii = art;
+  elem->type = type;
+  elem->point = (vector_t) {.x = x, .y = y};
+  elem->velocity = (vector_t) {.x = 0, .y = 0};
+  elem->acceleration = (vector_t) {.x = 0, .y = 0};
+  elem->ascii->ascii = ascii;
+  elem->ascii->width = width;
+  elem->ascii->height = height;
+  elem->ascii->color = 1;
+  elem->depth = 0;
+  return elem;
+}
+
+/**
+ * @brief Makes the paddles, at the sides, and the ball, in the middle.
+ *
+ * @returns An object list of the pong objects.
+ */
+object_list_t *new_pong_list(void) {
+  object_list_t *objects = new_list();
+  add_elem(objects, new_pong_elem(pong_paddle_left, 10, PONG_HEIGHT / 2, pong_paddle_ascii, 2, 20));
+  add_elem(objects, new_pong_elem(pong_paddle_right, PONG_WIDTH - 10, PONG_HEIGHT / 2, pong_paddle_ascii, 2, 20));
+  object_list_elem_t *ball = new_pong_elem(pong_ball, PONG_WIDTH / 2, PONG_HEIGHT / 2, pong_ball_ascii, 1, 1);
+  ball->velocity = (vector_t) {.x = 1, .y = 1};
+  add_elem(objects, ball);
+  return objects;
+}
+
+/**
+ * @brief Starts curses and sets up pong's colours.
+ */
+void init_pong_screen(void) {
+  cbreak();
+  init_screen();
+  noecho();
+  timeout(0);
+
+  start_color();
+  init_pair(1, COLOR_WHITE, COLOR_BLACK);
+  init_pair(2, COLOR_BLACK, COLOR_BLACK);
+  init_pair(3, COLOR_RED, COLOR_RED);
+  bkgd(COLOR_PAIR(3));
+}
+
+/**
+ * @brief Prints the left paddle's row on the first line, and the game below it.
+ *
+ * @param list The object list.
+ */
+void render_pong(object_list_t *list) {
+  move(0, 0);
+  printw("y1: %d\n", get_elem(list, pong_paddle_left)->point.y);
+  print_game(list, PONG_WIDTH, PONG_HEIGHT);
+}
@@ -0,0 +1,572 @@
+/**
+ * @file screen.c
+ * @brief Functions for presenting framebuffers to the terminal.
+ */
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "screen.h"
+
+/**
+ * Unchanged cells are sent anyway in gaps up to this long, as joining two
+ * runs is cheaper than moving the cursor between them.
+ */
+#define RUN_GAP 4
+
+/** Most bytes an ANSI cursor move or colour change takes, "\x1b[38;5;255;48;5;255m". */
+#define MAX_ESCAPE 20
+
+/** How frames are sent to the terminal. */
+static screen_backend_t screen_backend = backend_curses;
+
+/** The kernel's I/O counts for the thread drawing the screen, -1 if unavailable. */
+static int io_fd = -1;
+
+/**
+ * @brief Returns a new framebuffer.
+ *
+ * @param width Width of the screen, in characters.
+ * @param height Height of the screen, in characters.
+ * @returns New framebuffer, its contents not yet set.
+ */
+framebuffer_t *new_framebuffer(int width, int height) {
+  framebuffer_t *framebuffer = (framebuffer_t *) malloc(sizeof(framebuffer_t));
+  if (!framebuffer) {
+    perror("Unable to allocate memory for framebuffer");
+    exit(EXIT_FAILURE);
+  }
+  framebuffer->width = width;
+  framebuffer->height = height;
+  framebuffer->chars = (char *) malloc(sizeof(char) * width * height);
+  framebuffer->colors = (int *) malloc(sizeof(int) * width * height);
+  if (!framebuffer->chars || !framebuffer->colors) {
+    perror("Unable to allocate memory for framebuffer");
+    exit(EXIT_FAILURE);
+  }
+  return framebuffer;
+}
+
+/**
+ * @brief Free's a framebuffer.
+ *
+ * @param framebuffer Framebuffer to free, may be NULL.
+ */
+void free_framebuffer(framebuffer_t *framebuffer) {
+  if (framebuffer != NULL) {
+    free(framebuffer->chars);
+    free(framebuffer->colors);
+    free(framebuffer);
+  }
+}
+
+/**
+ * @brief Chooses how frames are sent to the terminal.
+ *
+ * @param backend The backend, curses unless this is called.
+ */
+void select_screen_backend(screen_backend_t backend) {
+  screen_backend = backend;
+}
+
+/**
+ * @brief Starts curses with initscr, and starts counting what it writes.
+ *
+ * Must be called from the thread that draws the screen. Like initscr, calls
+ * after the first do nothing, so games can restart.
+ */
+void init_screen(void) {
+  if (stdscr != NULL) {
+    return;
+  }
+  initscr();
+  // Curses writes straight to the terminal, so the kernel does the counting.
+  io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * @brief Returns the number of bytes this thread has written.
+ *
+ * @returns Bytes written, or -1 if they cannot be counted.
+ */
+long screen_bytes_written(void) {
+  char io[512];
+  ssize_t length = io_fd == -1 ? -1 : pread(io_fd, io, sizeof(io) - 1, 0);
+  if (length <= 0) {
+    return -1;
+  }
+  io[length] = '\0';
+  const char *wchar = strstr(io, "wchar: ");
+  return wchar ? atol(wchar + 7) : -1;
+}
+
+/**
+ * @brief Returns a new presenter, with nothing on the terminal yet.
+ *
+ * @param width Width of the frames, in characters.
+ * @param height Height of the frames, in characters.
+ * @returns New presenter.
+ */
+presenter_t *new_presenter(int width, int height) {
+  presenter_t *presenter = (presenter_t *) malloc(sizeof(presenter_t));
+  if (!presenter) {
+    perror("Unable to allocate memory for presenter");
+    exit(EXIT_FAILURE);
+  }
+  presenter->front = new_framebuffer(width, height);
+  presenter->back = new_framebuffer(width, height);
+  presenter->top = 0;
+  presenter->drawn = 0;
+  presenter->lines = 0;
+  presenter->columns = 0;
+  presenter->frames = 0;
+  presenter->cells = 0;
+  presenter->calls = 0;
+  presenter->last_bytes = 0;
+  presenter->bytes = 0;
+  presenter->worst_bytes = 0;
+  presenter->bytes_uncounted = 0;
+  presenter->output = NULL;
+  return presenter;
+}
+
+/**
+ * @brief Returns if a cell of the back frame differs from the terminal.
+ */
+static int is_changed(presenter_t *presenter, int i) {
+  return !presenter->drawn || presenter->front->chars[i] != presenter->back->chars[i]
+    || presenter->front->colors[i] != presenter->back->colors[i];
+}
+
+/**
+ * @brief Finds the next run of cells in a row that must be sent.
+ *
+ * @param presenter The presenter, with the next frame in back.
+ * @param y Row to look in.
+ * @param x Column to start looking from.
+ * @param end Set to the column after the run.
+ * @returns Column the run starts at, or -1 if the rest of the row is unchanged.
+ */
+int find_changed_run(presenter_t *presenter, int y, int x, int *end) {
+  int width = presenter->back->width;
+  int row = y * width;
+  while (x < width && !is_changed(presenter, row + x)) {
+    x++;
+  }
+  if (x >= width) {
+    return -1;
+  }
+
+  int start = x;
+  int last = x;
+  for (x++; x < width && x - last <= RUN_GAP; x++) {
+    if (is_changed(presenter, row + x)) {
+      last = x;
+    }
+  }
+  *end = last + 1;
+  return start;
+}
+
+/**
+ * @brief Returns the colour pair a cell is drawn with.
+ *
+ * Spaces take the pair twice the cell's colour, which games define with the
+ * foreground the same as the background.
+ * @param framebuffer Framebuffer the cell is in.
+ * @param i Index of the cell.
+ * @returns The colour pair.
+ */
+static int cell_pair(framebuffer_t *framebuffer, int i) {
+  return framebuffer->chars[i] == ' ' ? framebuffer->colors[i] * 2 : framebuffer->colors[i];
+}
+
+/**
+ * @brief Finds where a run of cells with the same colour pair ends.
+ *
+ * @param framebuffer Framebuffer the cells are in.
+ * @param i Index of the first cell in the run.
+ * @param end Index to stop at, the end of the changed run.
+ * @param pair Set to the colour pair of the run.
+ * @param blank Set to 1 if the run is all spaces, 0 otherwise.
+ * @returns Index after the last cell in the run.
+ */
+static int find_pair_run(framebuffer_t *framebuffer, int i, int end, int *pair, int *blank) {
+  *pair = cell_pair(framebuffer, i);
+  *blank = 1;
+  for (; i < end && cell_pair(framebuffer, i) == *pair; i++) {
+    if (framebuffer->chars[i] != ' ') {
+      *blank = 0;
+    }
+  }
+  return i;
+}
+
+/**
+ * @brief Sends the changed cells with curses.
+ *
+ * Each run of cells with the same colour pair is sent with one attrset, if
+ * the pair changes, and one addnstr.
+ * @param presenter The presenter, with the next frame in back.
+ * @param top Terminal row to draw the frame from.
+ */
+static void present_curses(presenter_t *presenter, int top) {
+  framebuffer_t *back = presenter->back;
+  int current_pair = -1;
+  for (int y = 0; y < back->height; y++) {
+    int end;
+    int x = 0;
+    while ((x = find_changed_run(presenter, y, x, &end)) != -1) {
+      move(top + y, x);
+      presenter->cells += end - x;
+      presenter->calls++;
+      int row = y * back->width;
+      for (int i = row + x; i < row + end;) {
+        int pair;
+        int blank;
+        int run_end = find_pair_run(back, i, row + end, &pair, &blank);
+        if (pair != current_pair) {
+          attrset(COLOR_PAIR(pair));
+          current_pair = pair;
+          presenter->calls++;
+        }
+        addnstr(back->chars + i, run_end - i);
+        presenter->calls++;
+        i = run_end;
+      }
+      x = end;
+    }
+  }
+  refresh();
+}
+
+/**
+ * @brief Returns the number of decimal digits in a number.
+ */
+static int count_digits(int n) {
+  int digits = 1;
+  while (n >= 10) {
+    n /= 10;
+    digits++;
+  }
+  return digits;
+}
+
+/**
+ * @brief Writes a number in decimal.
+ *
+ * @param out Where to write it.
+ * @param n Number to write, at least 0.
+ * @returns The end of what was written.
+ */
+static char *append_number(char *out, int n) {
+  int digits = count_digits(n);
+  for (int i = digits - 1; i >= 0; i--) {
+    out[i] = '0' + n % 10;
+    n /= 10;
+  }
+  return out + digits;
+}
+
+/**
+ * @brief Writes the shortest escape sequence that moves the cursor.
+ *
+ * @param out Where to write it.
+ * @param y Row to move to, from 0.
+ * @param x Column to move to, from 0.
+ * @param cursor_y Row the cursor is on, -1 if unknown.
+ * @param cursor_x Column the cursor is on.
+ * @returns The end of what was written.
+ */
+static char *append_move(char *out, int y, int x, int cursor_y, int cursor_x) {
+  if (y == cursor_y && x == cursor_x) {
+    return out;
+  }
+  if (y == cursor_y && x == 0) {
+    *out++ = '\r';
+    return out;
+  }
+  // Moving right along the row, CUF, is shorter than CUP unless far from the left edge.
+  int forward = y == cursor_y && x > cursor_x ? x - cursor_x : 0;
+  int cup_length = 3 + count_digits(y + 1) + (x > 0 ? 1 + count_digits(x + 1) : 0);
+  int cuf_length = 3 + (forward > 1 ? count_digits(forward) : 0);
+  *out++ = '\x1b';
+  *out++ = '[';
+  if (forward > 0 && cuf_length < cup_length) {
+    if (forward > 1) {
+      out = append_number(out, forward);
+    }
+    *out++ = 'C';
+    return out;
+  }
+  out = append_number(out, y + 1);
+  if (x > 0) {
+    *out++ = ';';
+    out = append_number(out, x + 1);
+  }
+  *out++ = 'H';
+  return out;
+}
+
+/**
+ * @brief Writes the SGR parameter for one colour.
+ *
+ * @param out Where to write it.
+ * @param color Colour, -1 for the default, 0 to 15 for the basic and bright
+ *        colours, or up to 255 for the rest of the 256 colour palette.
+ * @param base 30 for the foreground, 40 for the background.
+ * @returns The end of what was written.
+ */
+static char *append_color(char *out, int color, int base) {
+  if (color < 0) {
+    return append_number(out, base + 9);
+  }
+  if (color < 8) {
+    return append_number(out, base + color);
+  }
+  if (color < 16) {
+    return append_number(out, base + 60 + color - 8);
+  }
+  out = append_number(out, base + 8);
+  memcpy(out, ";5;", 3);
+  return append_number(out + 3, color);
+}
+
+/**
+ * @brief Writes the SGR sequence that changes the colours, if they need to.
+ *
+ * @param out Where to write it.
+ * @param fg Set to the foreground, -2 if unknown.
+ * @param bg Set to the background, -2 if unknown.
+ * @param new_fg Foreground wanted, -1 for the default, or -2 if it does not matter.
+ * @param new_bg Background wanted, -1 for the default.
+ * @returns The end of what was written.
+ */
+static char *append_colors(char *out, int *fg, int *bg, int new_fg, int new_bg) {
+  int change_fg = new_fg != -2 && new_fg != *fg;
+  int change_bg = new_bg != *bg;
+  if (!change_fg && !change_bg) {
+    return out;
+  }
+  *out++ = '\x1b';
+  *out++ = '[';
+  if (change_fg) {
+    out = append_color(out, new_fg, 30);
+    *fg = new_fg;
+  }
+  if (change_fg && change_bg) {
+    *out++ = ';';
+  }
+  if (change_bg) {
+    out = append_color(out, new_bg, 40);
+    *bg = new_bg;
+  }
+  *out++ = 'm';
+  return out;
+}
+
+/**
+ * @brief Writes the changed cells as ANSI escape sequences.
+ *
+ * The cursor position and colours are not assumed at the start, and are
+ * left wherever the last cell put them. Cells off the edge of the terminal
+ * are left out.
+ * @param presenter The presenter, with the next frame in back.
+ * @param out Where to write, room for every cell to need a cursor move and
+ *        a colour change.
+ * @param top Terminal row to draw the frame from.
+ * @param lines Height of the terminal.
+ * @param columns Width of the terminal.
+ * @param pair_colors Gives the colours of a colour pair, like pair_content.
+ * @returns The end of what was written.
+ */
+char *encode_ansi(presenter_t *presenter, char *out, int top, int lines, int columns, pair_colors_t *pair_colors) {
+  framebuffer_t *back = presenter->back;
+  int terminal_columns = columns;
+  int rows = lines - top < back->height ? lines - top : back->height;
+  columns = columns < back->width ? columns : back->width;
+  int cursor_y = -1;
+  int cursor_x = 0;
+  int fg = -2;
+  int bg = -2;
+  for (int y = 0; y < rows; y++) {
+    int end;
+    int x = 0;
+    while ((x = find_changed_run(presenter, y, x, &end)) != -1 && x < columns) {
+      end = end < columns ? end : columns;
+      out = append_move(out, top + y, x, cursor_y, cursor_x);
+      presenter->cells += end - x;
+      int row = y * back->width;
+      for (int i = row + x; i < row + end;) {
+        int pair;
+        int blank;
+        int run_end = find_pair_run(back, i, row + end, &pair, &blank);
+        short pair_fg;
+        short pair_bg;
+        pair_colors(pair, &pair_fg, &pair_bg);
+        // Spaces only show their background, so the foreground can stay as it is.
+        out = append_colors(out, &fg, &bg, blank ? -2 : pair_fg, pair_bg);
+        memcpy(out, back->chars + i, run_end - i);
+        out += run_end - i;
+        i = run_end;
+      }
+      x = end;
+      cursor_y = top + y;
+      cursor_x = end;
+      // At the right edge the terminal is waiting to wrap, so the position is not known.
+      if (end >= terminal_columns) {
+        cursor_y = -1;
+      }
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Returns if curses will repaint any of the frame's rows on its next refresh.
+ *
+ * Curses does not know what the ANSI backend sent, so a repaint puts back
+ * what it thinks is there, wiping the frame. It repaints everything after
+ * clear, endwin or a resize, and any line of stdscr drawn on since the last
+ * refresh, such as by bkgd.
+ * @param presenter The presenter.
+ * @param top Terminal row to draw the frame from.
+ */
+static int curses_will_repaint(presenter_t *presenter, int top) {
+  if (isendwin() || is_cleared(curscr) || is_cleared(stdscr) || LINES != presenter->lines
+      || COLS != presenter->columns) {
+    return 1;
+  }
+  for (int y = top; y < top + presenter->back->height && y < LINES; y++) {
+    if (is_linetouched(stdscr, y) == TRUE) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Sends the changed cells as one buffer of ANSI escape sequences.
+ *
+ * The frame's rows belong to this backend and the rest of the terminal to
+ * curses, which is refreshed first for anything drawn there, like a status
+ * line. Should that refresh repaint the frame's rows the whole frame is sent
+ * again. The cursor and colours are put back as curses left them, so it can
+ * go on updating its part. Games must not draw over the frame's rows with
+ * curses, nor call clear between presenting and getch, whose refresh would
+ * wipe the frame until it next changes.
+ * @param presenter The presenter, with the next frame in back.
+ * @param top Terminal row to draw the frame from.
+ */
+static void present_ansi(presenter_t *presenter, int top) {
+  framebuffer_t *back = presenter->back;
+  if (presenter->output == NULL) {
+    // Every cell may need a cursor move, a colour change and its char.
+    presenter->output = (char *) malloc((size_t) back->width * back->height * (2 * MAX_ESCAPE + 1) + 2 * MAX_ESCAPE);
+    if (presenter->output == NULL) {
+      perror("Unable to allocate memory for presenter");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (curses_will_repaint(presenter, top)) {
+    presenter->drawn = 0;
+    presenter->lines = LINES;
+    presenter->columns = COLS;
+  }
+  refresh();
+
+  char *out = encode_ansi(presenter, presenter->output, top, LINES, COLS, pair_content);
+  if (out != presenter->output) {
+    out = append_move(out, getcury(curscr), getcurx(curscr), -1, 0);
+    memcpy(out, "\x1b[m", 3);
+    out += 3;
+  }
+  for (char *next = presenter->output; next < out;) {
+    ssize_t written = write(STDOUT_FILENO, next, out - next);
+    presenter->calls++;
+    if (written == -1) {
+      perror("Unable to write to the terminal");
+      exit(EXIT_FAILURE);
+    }
+    next += written;
+  }
+}
+
+/**
+ * @brief Sends the back frame to the terminal, then swaps it to the front.
+ *
+ * Only the runs of cells that changed are sent, and the screen is never
+ * cleared, so a still frame costs nearly nothing.
+ * @param presenter The presenter, with the next frame in back.
+ * @param top Terminal row to draw the frame from.
+ */
+void present(presenter_t *presenter, int top) {
+  if (top != presenter->top) {
+    presenter->top = top;
+    presenter->drawn = 0;
+  }
+  long before = screen_bytes_written();
+
+  if (screen_backend == backend_ansi) {
+    present_ansi(presenter, top);
+  } else {
+    present_curses(presenter, top);
+  }
+
+  long after = screen_bytes_written();
+  presenter->last_bytes = before == -1 || after == -1 ? -1 : after - before;
+  if (presenter->last_bytes >= 0) {
+    presenter->bytes += presenter->last_bytes;
+    if (presenter->last_bytes > presenter->worst_bytes) {
+      presenter->worst_bytes = presenter->last_bytes;
+    }
+  } else {
+    presenter->bytes_uncounted = 1;
+  }
+  presenter->frames++;
+  swap_frames(presenter);
+}
+
+/**
+ * @brief Makes the back frame the one on the terminal, and reuses the old front for the next.
+ *
+ * @param presenter The presenter, with the frame just sent in back.
+ */
+void swap_frames(presenter_t *presenter) {
+  framebuffer_t *back = presenter->back;
+  presenter->back = presenter->front;
+  presenter->front = back;
+  presenter->drawn = 1;
+}
+
+/**
+ * @brief Prints how much was sent to the terminal per frame.
+ *
+ * @param presenter The presenter, may be NULL if nothing was presented.
+ */
+void print_presenter_stats(presenter_t *presenter) {
+  if (presenter == NULL || presenter->frames == 0) {
+    return;
+  }
+  int cells = presenter->front->width * presenter->front->height;
+  printf("Presented %ld frames, sending %.1f%% of the cells with %.0f calls each", presenter->frames,
+         100.0 * presenter->cells / presenter->frames / cells, (double) presenter->calls / presenter->frames);
+  if (!presenter->bytes_uncounted) {
+    printf(" in %.0f bytes each on average and %ld at most",
+           (double) presenter->bytes / presenter->frames, presenter->worst_bytes);
+  }
+  printf(".\n");
+}
+
+/**
+ * @brief Free's a presenter.
+ *
+ * @param presenter Presenter to free, may be NULL.
+ */
+void free_presenter(presenter_t *presenter) {
+  if (presenter != NULL) {
+    free_framebuffer(presenter->front);
+    free_framebuffer(presenter->back);
+    free(presenter->output);
+    free(presenter);
+  }
+}
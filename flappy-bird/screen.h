@@ -0,0 +1,93 @@
+/**
+ * @file screen.h
+ * @brief Framebuffers and presenting them to the terminal.
+ */
+#ifndef screen_h
+#define screen_h
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ncurses.h>
+
+/**
+ * @brief A struct to store a rendered screen, one char and colour per cell.
+ */
+typedef struct {
+  /** Width of the screen, in characters. */
+  int width;
+  /** Height of the screen, in characters. */
+  int height;
+  /** The char in each cell, row by row. */
+  char *chars;
+  /** The colour pair of each cell, row by row. */
+  int *colors;
+} framebuffer_t;
+
+/**
+ * @brief An enum to store how frames are sent to the terminal.
+ */
+typedef enum {
+  /** Cell by cell through curses. */
+  backend_curses,
+  /**
+   * As ANSI escape sequences built in one buffer and written at once. Curses
+   * still reads the keys and draws the rest of the terminal, but must not
+   * draw over the frame's rows.
+   */
+  backend_ansi,
+} screen_backend_t;
+
+/** Gives the foreground and background colours of a colour pair, like pair_content. */
+typedef int pair_colors_t(short pair, short *fg, short *bg);
+
+/**
+ * @brief A struct to store the frame on the terminal and the next one.
+ *
+ * Frames are rendered into back, and present only sends the cells that
+ * differ from front, which is what the terminal already shows.
+ */
+typedef struct {
+  /** The frame on the terminal. */
+  framebuffer_t *front;
+  /** The frame being rendered. */
+  framebuffer_t *back;
+  /** The terminal row the frames are drawn from. */
+  int top;
+  /** 1 once front is on the terminal, 0 if everything must be sent. */
+  int drawn;
+  /** Height of the terminal the ANSI backend last sent the whole frame to. */
+  int lines;
+  /** Width of the terminal the ANSI backend last sent the whole frame to. */
+  int columns;
+  /** Number of frames presented. */
+  long frames;
+  /** Number of cells sent, over all frames. */
+  long cells;
+  /** Number of curses drawing calls or writes made, over all frames. */
+  long calls;
+  /** Bytes written to the terminal for the last frame, -1 if they cannot be counted. */
+  long last_bytes;
+  /** Bytes written to the terminal, over all frames. */
+  long bytes;
+  /** Most bytes written to the terminal for one frame. */
+  long worst_bytes;
+  /** 1 if the bytes of any frame could not be counted, so bytes is not a total. */
+  int bytes_uncounted;
+  /** Where the ANSI backend builds each frame, made on first use. */
+  char *output;
+} presenter_t;
+
+framebuffer_t *new_framebuffer(int width, int height);
+void free_framebuffer(framebuffer_t *framebuffer);
+void select_screen_backend(screen_backend_t backend);
+void init_screen(void);
+long screen_bytes_written(void);
+presenter_t *new_presenter(int width, int height);
+int find_changed_run(presenter_t *presenter, int y, int x, int *end);
+char *encode_ansi(presenter_t *presenter, char *out, int top, int lines, int columns, pair_colors_t *pair_colors);
+void present(presenter_t *presenter, int top);
+void swap_frames(presenter_t *presenter);
+void print_presenter_stats(presenter_t *presenter);
+void free_presenter(presenter_t *presenter);
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file screen_benchmark.c
+ * @brief Times each screen backend drawing the flappy bird and pong screens into a pseudo terminal.
+ */
+#include <poll.h>
+#include <pty.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "flappy_bird.h"
+#include "screen.h"
+#include "pong_scene.c"
+
+/** Frames rendered with each backend. */
+#define BENCHMARK_FRAMES 300
+/** Frames between each flap, which keeps the bird on the screen. */
+#define FLAP_INTERVAL 8
+
+/**
+ * @brief A struct to store a screen to draw, and how to play it.
+ */
+typedef struct {
+  /** Name printed with the results. */
+  const char *name;
+  /** Width of the screen, in characters. */
+  int width;
+  /** Height of the screen, in characters. */
+  int height;
+  /** Makes the objects and starts curses, like the game's init_game. */
+  object_list_t *(*init)(void);
+  /** Updates and renders one frame. */
+  void (*step)(object_list_t *list, int frame);
+} scene_t;
+
+/**
+ * @brief A struct to store what a backend took to draw the frames.
+ */
+typedef struct {
+  /** Number of frames presented. */
+  long frames;
+  /** Number of cells sent, over all frames. */
+  long cells;
+  /** Number of curses drawing calls or writes made, over all frames. */
+  long calls;
+  /** Bytes written to the terminal, over all frames, -1 if they could not be counted. */
+  long bytes;
+  /** Most bytes written to the terminal for one frame. */
+  long worst_bytes;
+  /** Seconds spent rendering and presenting, over all frames. */
+  double seconds;
+} benchmark_result_t;
+
+/**
+ * @brief Returns a monotonic time in seconds.
+ */
+double benchmark_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Plays a frame of flappy bird, flapping every FLAP_INTERVAL frames.
+ *
+ * @param list The object list.
+ * @param frame Number of the frame.
+ */
+void step_flappy_bird(object_list_t *list, int frame) {
+  if (frame % FLAP_INTERVAL == 0) {
+    for_all(list, flap);
+  }
+  render_game(list);
+}
+
+/**
+ * @brief Makes the pong screen, as pong.c's init_game does.
+ *
+ * @returns The object list.
+ */
+object_list_t *init_pong(void) {
+  object_list_t *list = new_pong_list();
+  init_pong_screen();
+  return list;
+}
+
+/**
+ * @brief Plays a frame of pong, with the paddles swept up and down instead of tracking hands.
+ *
+ * @param list The object list.
+ * @param frame Number of the frame.
+ */
+void step_pong(object_list_t *list, int frame) {
+  object_list_elem_t *ball = get_elem(list, pong_ball);
+  if ((ball->point.y <= 0 && ball->velocity.y <= 0) || (ball->point.y >= PONG_HEIGHT && ball->velocity.y >= 0)) {
+    ball->velocity.y *= -1;
+  }
+  get_elem(list, pong_paddle_left)->point.y = PONG_HEIGHT / 2 + frame % 40 - 20;
+  get_elem(list, pong_paddle_right)->point.y = PONG_HEIGHT / 2 - frame % 30 + 15;
+  for_all(list, move_object);
+  render_pong(list);
+}
+
+/**
+ * @brief Plays a scene with a backend, in the child with the pseudo terminal.
+ *
+ * @param scene Scene to play.
+ * @param backend Backend to draw with.
+ * @param result_fd Where to write the benchmark_result_t.
+ */
+void play(const scene_t *scene, screen_backend_t backend, int result_fd) {
+  // The same terminal type for every run, whatever this was started from.
+  setenv("TERM", "xterm-256color", 1);
+  select_screen_backend(backend);
+  object_list_t *objects = scene->init();
+
+  double start = benchmark_seconds();
+  for (int i = 0; i < BENCHMARK_FRAMES; i++) {
+    scene->step(objects, i);
+  }
+  benchmark_result_t result;
+  result.seconds = benchmark_seconds() - start;
+  endwin();
+
+  presenter_t *presenter = objects->presenter;
+  result.frames = presenter->frames;
+  result.cells = presenter->cells;
+  result.calls = presenter->calls;
+  result.bytes = presenter->bytes_uncounted ? -1 : presenter->bytes;
+  result.worst_bytes = presenter->worst_bytes;
+  if (write(result_fd, &result, sizeof(result)) != sizeof(result)) {
+    perror("Unable to send the result");
+    exit(EXIT_FAILURE);
+  }
+  free_object_list(objects);
+}
+
+/**
+ * @brief Runs a scene with a backend in a pseudo terminal, reading what it draws.
+ *
+ * @param scene Scene to play.
+ * @param backend Backend to draw with.
+ * @returns What the backend took to draw the frames.
+ */
+benchmark_result_t run(const scene_t *scene, screen_backend_t backend) {
+  int result_pipe[2];
+  if (pipe(result_pipe) == -1) {
+    perror("Unable to create pipe");
+    exit(EXIT_FAILURE);
+  }
+  struct winsize size = {scene->height + 20, scene->width + 20, 0, 0};
+  int master;
+  pid_t pid = forkpty(&master, NULL, NULL, &size);
+  if (pid == -1) {
+    perror("Unable to create pseudo terminal");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(result_pipe[0]);
+    play(scene, backend, result_pipe[1]);
+    exit(EXIT_SUCCESS);
+  }
+  close(result_pipe[1]);
+
+  // What is drawn has to be read, or the game blocks once the terminal fills up.
+  char output[1 << 16];
+  while (read(master, output, sizeof(output)) > 0) {
+  }
+  close(master);
+
+  benchmark_result_t result;
+  int status;
+  if (read(result_pipe[0], &result, sizeof(result)) != sizeof(result)
+      || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    fprintf(stderr, "The game did not finish\n");
+    exit(EXIT_FAILURE);
+  }
+  close(result_pipe[0]);
+  return result;
+}
+
+/**
+ * @brief Prints what each backend took to draw the same frames of each scene.
+ */
+int main(int argc, char **argv) {
+  const scene_t scenes[] = {
+    {"flappy bird", WIDTH, HEIGHT, init_game, step_flappy_bird},
+    {"pong", PONG_WIDTH, PONG_HEIGHT, init_pong, step_pong},
+  };
+  const char *names[] = {"curses", "ansi"};
+  screen_backend_t backends[] = {backend_curses, backend_ansi};
+
+  for (int s = 0; s < 2; s++) {
+    printf("%d frames of %dx%d %s:\n", BENCHMARK_FRAMES, scenes[s].width, scenes[s].height, scenes[s].name);
+    printf("%-8s %12s %12s %12s %12s %12s\n", "backend", "cells/frame", "calls/frame", "bytes/frame",
+           "worst bytes", "us/frame");
+    for (int i = 0; i < 2; i++) {
+      benchmark_result_t result = run(&scenes[s], backends[i]);
+      printf("%-8s %12ld %12ld ", names[i], result.cells / result.frames, result.calls / result.frames);
+      if (result.bytes >= 0) {
+        printf("%12ld %12ld ", result.bytes / result.frames, result.worst_bytes);
+      } else {
+        printf("%12s %12s ", "?", "?");
+      }
+      printf("%12.1f\n", result.seconds * 1e6 / result.frames);
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -80,7 +80,7 @@ object_list_t *init_game(void) {
   for_all(objects, print_object);
 
   cbreak();
-  initscr();
+  init_screen();
   noecho();
   timeout(100);
 
@@ -153,11 +153,10 @@ void hit_apple(object_list_t *list) {
  * @param dir Direction for the snake head to go.
  */
 void render_game(object_list_t *list, vector_t dir) {
-  clear();
+  move(0, 0);
   move_snake(list, dir);
   hit_apple(list);
   print_game(list, WIDTH, HEIGHT);
-  refresh();
 }
 
 /**
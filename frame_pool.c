@@ -0,0 +1,152 @@
+/**
+ * @file frame_pool.c
+ * @brief A pool of images and scratch memory reused from frame to frame.
+ */
+
+#include <pthread.h>
+
+/** The most images the pool can hold. */
+#define FRAME_POOL_SIZE 32
+/** Alignment of every image and of each of its rows, a cache line and an AVX-512 vector. */
+#define FRAME_ALIGN 64
+
+/**
+ * @brief A struct that holds every image the vision pipeline works in.
+ * Each image is a single aligned buffer with its rows padded to FRAME_ALIGN
+ * bytes, handed out as a cv::Mat header over it, so views of it can be passed
+ * to every stage without copying. Images are only ever created when no free
+ * one of the right shape is left, so once the first frame has been processed
+ * the pool allocates nothing more. OpenCV may still allocate internally, in
+ * cv::resize and cv::dft, which the pool neither sees nor counts.
+ */
+typedef struct {
+  /** The images, in use or free. */
+  cv::Mat images[FRAME_POOL_SIZE];
+  /** True for each image that has been acquired and not released. */
+  bool in_use[FRAME_POOL_SIZE];
+  /** Number of images in the pool. */
+  int count;
+  /** Number of heap allocations made by the pool, for checking it makes none per frame. */
+  long allocations;
+  /** Guards the images, as the capture and vision threads both use the pool. */
+  pthread_mutex_t lock;
+  /** Scratch memory for each band of a stage. */
+  void *scratch[MAX_BANDS];
+  /** Size of each band's scratch memory in bytes. */
+  size_t scratch_size[MAX_BANDS];
+} frame_pool_t;
+
+/** The pool shared by everything that works on frames. */
+static frame_pool_t frame_pool = {{}, {false}, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * @brief Gets how many heap allocations the pool has made.
+ * @returns The number of allocations so far.
+ */
+long frame_pool_allocations(void) {
+  return __atomic_load_n(&frame_pool.allocations, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Takes an image from the pool, creating one only if none of that shape is free.
+ * Its contents are whatever was last written to it.
+ * @param rows The height of the image.
+ * @param cols The width of the image.
+ * @param type The type of the image, such as CV_8UC3.
+ * @returns A header over the image, to be given back with release_mat.
+ */
+cv::Mat acquire_mat(int rows, int cols, int type) {
+  frame_pool_t *p = &frame_pool;
+  cv::Mat image;
+
+  pthread_mutex_lock(&p->lock);
+  for (int i = 0; i < p->count; i++) {
+    const cv::Mat &candidate = p->images[i];
+    if (!p->in_use[i] && candidate.rows == rows && candidate.cols == cols && candidate.type() == type) {
+      p->in_use[i] = true;
+      image = candidate;
+      break;
+    }
+  }
+
+  if (image.empty()) {
+    if (p->count == FRAME_POOL_SIZE) {
+      fprintf(stderr, "Frame pool is full\n");
+      exit(EXIT_FAILURE);
+    }
+    size_t step = ((size_t) cols * CV_ELEM_SIZE(type) + FRAME_ALIGN - 1) & ~(size_t) (FRAME_ALIGN - 1);
+    void *data;
+    if (posix_memalign(&data, FRAME_ALIGN, step * rows)) {
+      perror("Unable to allocate frame");
+      exit(EXIT_FAILURE);
+    }
+    image = cv::Mat(rows, cols, type, data, step);
+    p->images[p->count] = image;
+    p->in_use[p->count] = true;
+    p->count++;
+    __atomic_add_fetch(&p->allocations, 1, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&p->lock);
+
+  return image;
+}
+
+/**
+ * @brief Gives an image back to the pool for reuse.
+ * @param image A pointer to a header from acquire_mat, which is emptied. Does
+ *        nothing if it already is.
+ */
+void release_mat(cv::Mat *image) {
+  frame_pool_t *p = &frame_pool;
+  if (image->empty()) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  for (int i = 0; i < p->count; i++) {
+    if (p->images[i].data == image->data) {
+      p->in_use[i] = false;
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  image->release();
+}
+
+/**
+ * @brief Gets scratch memory for one band of a stage, growing it if it is too small.
+ * A band's memory is only valid until the next call for the same band.
+ * @param band The band, only one thread may use a band at a time.
+ * @param bytes The number of bytes needed.
+ * @returns The scratch memory.
+ */
+void *band_scratch(int band, size_t bytes) {
+  frame_pool_t *p = &frame_pool;
+  if (p->scratch_size[band] < bytes) {
+    free(p->scratch[band]);
+    p->scratch[band] = malloc(bytes);
+    p->scratch_size[band] = bytes;
+    __atomic_add_fetch(&p->allocations, 1, __ATOMIC_RELAXED);
+  }
+  return p->scratch[band];
+}
+
+/**
+ * @brief Frees every image and all the scratch memory in the pool.
+ * No image from the pool may be used afterwards.
+ */
+void free_frame_pool(void) {
+  frame_pool_t *p = &frame_pool;
+  pthread_mutex_lock(&p->lock);
+  for (int i = 0; i < p->count; i++) {
+    free(p->images[i].data);
+    p->images[i].release();
+    p->in_use[i] = false;
+  }
+  p->count = 0;
+  for (int band = 0; band < MAX_BANDS; band++) {
+    free(p->scratch[band]);
+    p->scratch[band] = NULL;
+    p->scratch_size[band] = 0;
+  }
+  pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,235 @@
+/**
+ * @file frame_source.c
+ * @brief Where the frames come from: a webcam, a video file, a raw video or a directory of images.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Frames per second files are replayed at when they do not say. */
+#define DEFAULT_REPLAY_FPS 30
+
+/**
+ * @brief The kinds of frame source.
+ */
+typedef enum {
+  /** A webcam, read as fast as it gives frames. */
+  source_camera,
+  /** A video file. */
+  source_video,
+  /** A directory of image files, read in name order. */
+  source_images,
+  /** A raw video file, read straight out of a memory mapping. */
+  source_raw,
+} frame_source_type_t;
+
+/**
+ * @brief A struct that holds an open frame source.
+ * Recorded sources can be replayed in real time, at the rate they were
+ * recorded, or as fast as they can be read, so the whole pipeline can be
+ * profiled and tested without a webcam.
+ */
+typedef struct {
+  /** The kind of source. */
+  frame_source_type_t type;
+  /** The webcam or video file, unused for images. */
+  CvCapture *capture;
+  /** The image file names, sorted, for images. */
+  struct dirent **names;
+  /** Number of image files. */
+  int name_count;
+  /** The directory the images are in. */
+  char *directory;
+  /** The mapped raw video, for raw. */
+  raw_video_t *raw;
+  /** The last image read or converted, kept until the next one is. */
+  cv::Mat image;
+  /** True when frames stay valid and unchanged until the source is closed, so need not be copied. */
+  bool stable;
+  /** True to pace recorded sources at their frame rate, false to read them as fast as possible. */
+  bool realtime;
+  /** Frames per second of a recorded source. */
+  double fps;
+  /** When the first frame was read. */
+  double start_time;
+  /** Frames read so far. */
+  long frames;
+  /** True once a recorded source has no frames left. */
+  bool finished;
+} frame_source_t;
+
+/**
+ * @brief Gets the time from a monotonic clock.
+ * @returns The time in seconds.
+ */
+double monotonic_seconds(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Picks out the files in a directory that look like images.
+ * @param entry A directory entry.
+ * @returns Non zero iff the entry's name has an image extension.
+ */
+int is_image_file(const struct dirent *entry) {
+  const char *dot = strrchr(entry->d_name, '.');
+  if (!dot) {
+    return 0;
+  }
+  const char *extensions[] = {".png", ".jpg", ".jpeg", ".bmp", ".ppm", ".pgm", ".tif", ".tiff"};
+  for (int i = 0; i < (int) (sizeof(extensions) / sizeof(extensions[0])); i++) {
+    if (strcasecmp(dot, extensions[i]) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Opens a source of frames.
+ * Exits if the source cannot be opened, or is a directory without images.
+ * @param name "camera" or "camera:N" for webcam N, a directory of images, a
+ *        raw video ending in .raw, or a video file. A name ending in / is
+ *        always taken as a directory.
+ * @param realtime True to replay recorded sources at their frame rate, false
+ *        to read them as fast as possible. Webcams always run in real time.
+ * @returns A pointer to the new frame_source_t struct.
+ */
+frame_source_t *open_frame_source(const char *name, bool realtime) {
+  frame_source_t *s = new frame_source_t();
+  s->capture = NULL;
+  s->names = NULL;
+  s->name_count = 0;
+  s->directory = NULL;
+  s->raw = NULL;
+  s->stable = false;
+  s->realtime = realtime;
+  s->fps = DEFAULT_REPLAY_FPS;
+  s->start_time = 0;
+  s->frames = 0;
+  s->finished = false;
+
+  struct stat info;
+  size_t length = strlen(name);
+  if (strcmp(name, "camera") == 0 || strncmp(name, "camera:", 7) == 0) {
+    s->type = source_camera;
+    s->realtime = true;
+    s->capture = cvCaptureFromCAM(name[6] == ':' ? atoi(name + 7) : 0);
+  } else if ((length > 0 && name[length - 1] == '/') || (stat(name, &info) == 0 && S_ISDIR(info.st_mode))) {
+    s->type = source_images;
+    s->directory = strdup(name);
+    s->name_count = scandir(name, &s->names, is_image_file, alphasort);
+    if (s->name_count < 0) {
+      perror(name);
+      exit(EXIT_FAILURE);
+    }
+    if (s->name_count == 0) {
+      fprintf(stderr, "No images in %s\n", name);
+      exit(EXIT_FAILURE);
+    }
+  } else if (length > 4 && strcmp(name + length - 4, ".raw") == 0) {
+    s->type = source_raw;
+    s->raw = open_raw_video(name);
+    s->fps = s->raw->header->fps > 0 ? s->raw->header->fps : DEFAULT_REPLAY_FPS;
+    // BGR frames are handed out straight from the mapping.
+    s->stable = s->raw->header->format == raw_bgr;
+  } else {
+    s->type = source_video;
+    s->capture = cvCaptureFromFile(name);
+    if (s->capture) {
+      double fps = cvGetCaptureProperty(s->capture, CV_CAP_PROP_FPS);
+      s->fps = fps > 0 ? fps : DEFAULT_REPLAY_FPS;
+    }
+  }
+
+  if ((s->type == source_camera || s->type == source_video) && !s->capture) {
+    perror("Error when reading stream");
+    exit(EXIT_FAILURE);
+  }
+  return s;
+}
+
+/**
+ * @brief Reads the next frame from a source.
+ * Recorded sources replayed in real time wait until the frame is due.
+ * @param s The frame source.
+ * @returns A header over the BGR frame, valid until the next read, or until
+ *          the source is closed if stable is set, and never to be written
+ *          to. Empty if there is no frame yet, or none left once finished is
+ *          set.
+ */
+cv::Mat read_frame(frame_source_t *s) {
+  if (s->finished) {
+    return cv::Mat();
+  }
+
+  if (s->realtime && s->type != source_camera && s->frames > 0) {
+    double wait = s->start_time + s->frames / s->fps - monotonic_seconds();
+    if (wait > 0) {
+      usleep((useconds_t) (wait * 1e6));
+    }
+  }
+
+  cv::Mat frame;
+  if (s->type == source_images) {
+    if (s->frames < s->name_count) {
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%s/%s", s->directory, s->names[s->frames]->d_name);
+      s->image = cv::imread(path, 1);
+      if (s->image.empty()) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        exit(EXIT_FAILURE);
+      }
+      frame = s->image;
+    }
+  } else if (s->type == source_raw) {
+    if (s->frames < s->raw->header->frame_count) {
+      frame = raw_video_frame(s->raw, s->frames);
+      if (!s->stable) {
+        cv::cvtColor(frame, s->image, CV_YUV2BGR_YUYV);
+        frame = s->image;
+      }
+    }
+  } else {
+    IplImage *image = cvQueryFrame(s->capture);
+    if (image) {
+      frame = cv::cvarrToMat(image);
+    }
+  }
+
+  if (frame.empty()) {
+    s->finished = s->type != source_camera;
+    return frame;
+  }
+  if (s->frames == 0) {
+    s->start_time = monotonic_seconds();
+  }
+  s->frames++;
+  return frame;
+}
+
+/**
+ * @brief Closes a frame source and frees the frame_source_t struct.
+ * @param s The frame source to close.
+ */
+void close_frame_source(frame_source_t *s) {
+  if (s->capture) {
+    cvReleaseCapture(&s->capture);
+  }
+  for (int i = 0; i < s->name_count; i++) {
+    free(s->names[i]);
+  }
+  free(s->names);
+  free(s->directory);
+  if (s->raw) {
+    close_raw_video(s->raw);
+  }
+  delete s;
+}
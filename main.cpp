@@ -8,135 +8,155 @@
 #include "cv.h"
 #include "highgui.h"
 #include "uchar_array.c"
+#include "thread_pool.c"
+#include "frame_pool.c"
+#include "raw_video.c"
+#include "frame_source.c"
 #include "calibration.c"
 #include "threshold.c"
+#include "filter.c"
 #include "detection.c"
+#include "vision.c"
+#include "event_loop.c"
+#include "capture.c"
+#include "vision_thread.c"
+#include "scheduler.c"
+#include "flappy-bird/screen.c"
+#include "options.c"
 #include "flappy_bird.c"
 
-void generate_movement_frame(IplImage *debug_frame, const IplImage *prev_frame, const IplImage *frame);
+/** Seconds of game time per update, 20 a second. */
+#define GAME_TICK 0.05
+
+void generate_movement_frame(cv::Mat &debug_frame, const cv::Mat &prev_frame, const cv::Mat &frame);
 
 int main(int argc, char **argv) {
-  CvCapture *capture = 0;
-  IplImage *frame = 0;
-  IplImage *prev_frame = 0;
-  IplImage *result = 0;
-  IplImage *arm = 0;
-  CvScalar red = cvScalar(255, 0, 0);
-  capture = cvCaptureFromCAM(0);
   hands_t *hands = init_hands();
-  bool is_down = false;
-
-  if (!capture) {
-    perror("Error when reading stream");
-    exit(EXIT_FAILURE);
+  options_t options;
+  parse_options(argc, argv, &options);
+  // Without a display there are no HighGUI windows, only the terminal.
+  if (!has_display()) {
+    options.debug_view = debug_view_none;
   }
+  frame_source_t *source = open_frame_source(options.source, options.realtime);
+  hands->mode = options.detection_mode;
+  hands->pyramid_levels = options.pyramid_levels;
+  bool is_down = false;
 
-  calibration_t *c = (calibration_t *) malloc(sizeof(calibration_t));
-  calibrate(capture, c);
+  init_threshold();
+  init_thread_pool(options.threads);
 
-  cvNamedWindow("Arm Detection", 1);
-  cvNamedWindow("BW Matte", 1);
+  calibration_t *c = init_calibration();
+  c->mode = options.threshold_mode;
+  vision_thread_t *tracker = init_vision_thread(c, source, options.debug_view);
+  vision_t *vision = init_vision(options.full_frame_interval, options.scale);
+  capture_thread_t *camera = start_capture(source);
+  start_vision_thread(tracker, vision, camera, hands);
 
+  select_screen_backend(options.screen_backend);
   object_list_t *objects = init_game();
   int is_alive = 1;
-  clock_t last_frame = clock();
-
-  while (cvWaitKey(10) != 'q') {
-    frame = cvQueryFrame(capture);
-
-    if (frame) {
-      if (prev_frame) {
-        cvReleaseImage(&prev_frame);
-        prev_frame = cvCloneImage(frame);
-
-        cvCvtColor(frame, frame, CV_BGR2HSV);
-        cvReleaseImage(&arm);
-        arm = get_arm(frame, c);
-        cv::Mat image1 = cv::cvarrToMat(arm, false);
-        cv::medianBlur(image1, image1, 11);
-        arm = cvCreateImage(cvSize(image1.cols,image1.rows),8,arm->nChannels);
-        IplImage ipltemp=image1;
-        cvCopy(&ipltemp,arm);
-        cvCvtColor(frame, frame, CV_HSV2BGR);
-        detect_hands(arm, hands);
-
-        int half = frame->height / 2;
-
-        if (is_down && hands->left_y < half && hands->right_y < half) {
-          is_down = false;
-        } else if (!is_down && hands->left_y > half && hands->right_y > half) {
-          is_down = true;
-          for_all(objects, flap);
-        }
-
-        if (is_alive && clock() - last_frame >= 50 * 1000) {
-          last_frame = clock();
-          render_game(objects);
-        }
-        char c = 0;
+  scheduler_t *scheduler = init_scheduler(GAME_TICK, options.render_rate > 0 ? 1 / options.render_rate : 0,
+                                          monotonic_seconds());
+  event_loop_t *events = init_event_loop(STDIN_FILENO, tracker->ready_fd);
+  bool quit = false;
+
+  while (!quit) {
+    // Sleeps until a key is pressed, new hands are found or the game is due to update.
+    double now = monotonic_seconds();
+    int ready = wait_events(events, now + scheduler_timeout(scheduler, now));
+
+    if (ready & event_hands) {
+      // A recorded source ends the game once its last frame is tracked.
+      quit = pump_debug_view(tracker) || tracking_finished(tracker);
+    }
 
-        c = getch();
-        if (c == ' ') {
+    if (ready & event_input) {
+      int key;
+      while ((key = getch()) != ERR) {
+        quit = quit || key == 'q';
+        if (key == ' ') {
           for_all(objects, flap);
         }
 
-        if (c == 'r' || c == 'R') {
+        if (key == 'r' || key == 'R') {
           is_alive = 1;
           free_object_list(objects);
           objects = init_game();
         }
+      }
+    }
 
-        if (bird_coll(objects)) {
-          is_alive = 0;
-        }
+    hands_sample_t sample;
+    if (!read_hands(tracker, &sample)) {
+      continue;
+    }
+    *hands = sample.hands;
 
-        if (get_elem(objects, bird)->point.y > HEIGHT - 10) {
-          get_elem(objects, bird)->velocity.y = 0;
-          get_elem(objects, bird)->point.y = HEIGHT-10;
-        }
+    int half = sample.height / 2;
+
+    if (is_down && hands->left_y < half && hands->right_y < half) {
+      is_down = false;
+    } else if (!is_down && hands->left_y > half && hands->right_y > half) {
+      is_down = true;
+      for_all(objects, flap);
+    }
 
-        cvCircle(frame, cvPoint(hands->left_x, hands->left_y), 10, red, 15);
-        cvCircle(frame, cvPoint(hands->right_x, hands->right_y), 10, red, 15);
-        cvShowImage("BW Matte", arm);
+    // The game advances in fixed steps however long the vision took.
+    int ticks = scheduler_ticks(scheduler, monotonic_seconds());
+    for (int i = 0; i < ticks && is_alive; i++) {
+      update_game(objects);
 
-      } else {
-        arm = cvCreateImage(cvGetSize(frame), IPL_DEPTH_8U, 1);
+      if (bird_coll(objects)) {
+        is_alive = 0;
       }
 
-      cvReleaseImage(&prev_frame);
-      prev_frame = cvCloneImage(frame);
-      cvFlip(frame, frame, 1);
-      cvShowImage("Arm Detection", frame);
+      if (get_elem(objects, bird)->point.y > HEIGHT - 10) {
+        get_elem(objects, bird)->velocity.y = 0;
+        get_elem(objects, bird)->point.y = HEIGHT-10;
+      }
+    }
+
+    if (scheduler_render(scheduler, monotonic_seconds(), ticks > 0) && is_alive) {
+      render_game(objects);
     }
   }
 
   sleep(5);
   endwin();
   printf("\nYou died!\n");
+  stop_vision_thread(tracker);
+  print_lut_stats(c);
+  printf("Dropped %ld stale webcam frames.\n", dropped_frames(camera));
+  print_scheduler_stats(scheduler);
+  print_presenter_stats(objects->presenter);
   for_all(objects, print_object);
 
-  cvDestroyWindow("Arm Detection");
-  cvDestroyWindow("BW Matte");
-  cvReleaseCapture(&capture);
-  cvReleaseImage(&frame);
-  cvReleaseImage(&prev_frame);
-  cvReleaseImage(&result);
-  cvReleaseImage(&arm);
+  stop_capture(camera);
+  close_frame_source(source);
 
   free_object_list(objects);
   free(hands);
-  free(c);
+  free(scheduler);
+  free_event_loop(events);
+  free_vision(vision);
+  free_calibration(c);
+  free_thread_pool();
+  free_frame_pool();
 
   return EXIT_SUCCESS;
 }
 
-void generate_movement_frame(IplImage *debug_frame, const IplImage *prev_frame, const IplImage *frame) {
-  for (int y = 0; y < debug_frame->height; y++) {
-    for (int x = 0; x < debug_frame->width * debug_frame->nChannels; x++) {
-      if (prev_frame->imageData[y * frame->widthStep + x] - frame->imageData[y * frame->widthStep + x] != 0) {
-        debug_frame->imageData[y * debug_frame->widthStep + x] = 255;
+void generate_movement_frame(cv::Mat &debug_frame, const cv::Mat &prev_frame, const cv::Mat &frame) {
+  for (int y = 0; y < debug_frame.rows; y++) {
+    const unsigned char *prev = prev_frame.ptr<unsigned char>(y);
+    const unsigned char *row = frame.ptr<unsigned char>(y);
+    unsigned char *out = debug_frame.ptr<unsigned char>(y);
+    for (int x = 0; x < debug_frame.cols * debug_frame.channels(); x++) {
+      if (prev[x] - row[x] != 0) {
+        out[x] = 255;
       } else {
-        debug_frame->imageData[y * debug_frame->widthStep + x] = 0;
+        out[x] = 0;
       }
     }
   }
@@ -0,0 +1,180 @@
+/**
+ * @file options.c
+ * @brief Command line options for the motion-controlled games.
+ */
+
+#include <string.h>
+#include "debug_view.h"
+#include "flappy-bird/screen.h"
+
+/**
+ * @brief A struct that holds the options given on the command line.
+ */
+typedef struct {
+  /** How skin pixels are classified. */
+  threshold_mode_t threshold_mode;
+  /** How the forces on the hand points are found. */
+  detection_mode_t detection_mode;
+  /** Number of mask resolutions the iterative detection uses. */
+  int pyramid_levels;
+  /** Frames between full frame passes when only the hand regions are processed, 0 for off. */
+  int full_frame_interval;
+  /** Size the frames are processed at relative to the webcam frames. */
+  double scale;
+  /** Number of threads the vision stages run on, 0 for one per core. */
+  int threads;
+  /** Frames per second the game is rendered at, 0 for after every update. */
+  double render_rate;
+  /** Where the debug windows are drawn, none when running headless. */
+  debug_view_mode_t debug_view;
+  /** Where the frames come from, as given to open_frame_source. */
+  const char *source;
+  /** True to replay recorded sources at their frame rate, false for as fast as possible. */
+  bool realtime;
+  /** How the game is sent to the terminal. */
+  screen_backend_t screen_backend;
+} options_t;
+
+/**
+ * @brief Prints how to run the program, then exits.
+ * @param name The name the program was run with.
+ */
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-t exact|lut|compare] [-d iterative|field|centroid] [-p levels] [-r frames] [-s scale] [-j threads] [-f fps] [-v none|inline|async] [-i source] [-x] [-o curses|ansi]\n", name);
+  fprintf(stderr, "  -t  How skin is detected: exact HSV test (default), colour lookup\n");
+  fprintf(stderr, "      table, or exact while counting where the table disagrees.\n");
+  fprintf(stderr, "  -d  How hands are tracked: summing forces every iteration (default),\n");
+  fprintf(stderr, "      from a force field computed once per frame, or by moving to the\n");
+  fprintf(stderr, "      centre of the nearby skin.\n");
+  fprintf(stderr, "  -p  Number of halved mask resolutions the early iterative detection\n");
+  fprintf(stderr, "      steps run on, from 1 (full resolution only, default) to %d.\n", MAX_PYRAMID_LEVELS);
+  fprintf(stderr, "  -r  Only process the pixels around each hand, with a full frame pass\n");
+  fprintf(stderr, "      every this many frames and whenever a hand is lost. 0 (default)\n");
+  fprintf(stderr, "      processes the whole frame every time.\n");
+  fprintf(stderr, "  -s  Size to shrink frames to before finding the hands, from above 0\n");
+  fprintf(stderr, "      to 1 (default). 0.5 tracks a 640x480 webcam at 320x240.\n");
+  fprintf(stderr, "  -j  Number of threads to split the vision stages over, 0 (default)\n");
+  fprintf(stderr, "      for one per core.\n");
+  fprintf(stderr, "  -f  Frames per second to render the game at, independent of its\n");
+  fprintf(stderr, "      speed. 0 renders after every update. Defaults to 30.\n");
+  fprintf(stderr, "  -v  Debug windows: none (headless, also skips the calibration window),\n");
+  fprintf(stderr, "      drawn by the game loop for every frame (default), or drawn by a\n");
+  fprintf(stderr, "      thread of their own at most %d times a second. Always none when\n", DEBUG_VIEW_HZ);
+  fprintf(stderr, "      there is no display.\n");
+  fprintf(stderr, "  -i  Where the frames come from: camera (default), camera:N for webcam\n");
+  fprintf(stderr, "      N, a video file, a raw video from record_raw or a directory of\n");
+  fprintf(stderr, "      images read in name order.\n");
+  fprintf(stderr, "  -x  Replay a video or images as fast as they can be tracked, without\n");
+  fprintf(stderr, "      dropping frames, instead of at their frame rate.\n");
+  fprintf(stderr, "  -o  How the game is drawn: through curses (default), or as ANSI\n");
+  fprintf(stderr, "      escapes built into one buffer and written at once each frame.\n");
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Reads the command line options.
+ * Options that are not given keep their default values. The debug view is
+ * taken as given, so callers without a display must turn it off.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param o The options struct to fill in.
+ */
+void parse_options(int argc, char **argv, options_t *o) {
+  o->threshold_mode = threshold_exact;
+  o->detection_mode = detect_iterative;
+  o->pyramid_levels = 1;
+  o->full_frame_interval = 0;
+  o->scale = 1;
+  o->threads = 0;
+  o->render_rate = 30;
+  o->debug_view = debug_view_inline;
+  o->source = "camera";
+  o->realtime = true;
+  o->screen_backend = backend_curses;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:d:p:r:s:j:f:v:i:xo:")) != -1) {
+    switch (opt) {
+      case 't':
+        if (strcmp(optarg, "exact") == 0) {
+          o->threshold_mode = threshold_exact;
+        } else if (strcmp(optarg, "lut") == 0) {
+          o->threshold_mode = threshold_lut;
+        } else if (strcmp(optarg, "compare") == 0) {
+          o->threshold_mode = threshold_compare;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'd':
+        if (strcmp(optarg, "iterative") == 0) {
+          o->detection_mode = detect_iterative;
+        } else if (strcmp(optarg, "field") == 0) {
+          o->detection_mode = detect_field;
+        } else if (strcmp(optarg, "centroid") == 0) {
+          o->detection_mode = detect_centroid;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'p':
+        o->pyramid_levels = atoi(optarg);
+        if (o->pyramid_levels < 1 || o->pyramid_levels > MAX_PYRAMID_LEVELS) {
+          usage(argv[0]);
+        }
+        break;
+      case 'r':
+        o->full_frame_interval = atoi(optarg);
+        if (o->full_frame_interval < 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 's':
+        o->scale = atof(optarg);
+        if (!(o->scale > 0 && o->scale <= 1)) {
+          usage(argv[0]);
+        }
+        break;
+      case 'j':
+        o->threads = atoi(optarg);
+        if (o->threads < 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'f':
+        o->render_rate = atof(optarg);
+        if (!(o->render_rate >= 0)) {
+          usage(argv[0]);
+        }
+        break;
+      case 'v':
+        if (strcmp(optarg, "none") == 0) {
+          o->debug_view = debug_view_none;
+        } else if (strcmp(optarg, "inline") == 0) {
+          o->debug_view = debug_view_inline;
+        } else if (strcmp(optarg, "async") == 0) {
+          o->debug_view = debug_view_async;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'i':
+        o->source = optarg;
+        break;
+      case 'x':
+        o->realtime = false;
+        break;
+      case 'o':
+        if (strcmp(optarg, "curses") == 0) {
+          o->screen_backend = backend_curses;
+        } else if (strcmp(optarg, "ansi") == 0) {
+          o->screen_backend = backend_ansi;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+}
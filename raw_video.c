@@ -0,0 +1,260 @@
+/**
+ * @file raw_video.c
+ * @brief A raw video container that is replayed straight out of a memory mapping.
+ * A file is a raw_video_header_t followed by frame_count frames of frame_size
+ * bytes each, uncompressed, so reading a frame costs nothing but the page
+ * faults. Frames start on FRAME_ALIGN byte boundaries.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The first bytes of every raw video file. */
+#define RAW_VIDEO_MAGIC "HANDRAW1"
+
+/**
+ * @brief How the pixels of each frame are stored.
+ */
+typedef enum {
+  /** 3 bytes per pixel, blue green red, as the vision pipeline uses them. */
+  raw_bgr = 0,
+  /** 2 bytes per pixel, luma for each and chroma shared by pairs, as most webcams send them. */
+  raw_yuyv = 1,
+} raw_format_t;
+
+/**
+ * @brief The header at the start of a raw video file, padded to FRAME_ALIGN bytes.
+ */
+typedef struct {
+  /** RAW_VIDEO_MAGIC, not null terminated. */
+  char magic[8];
+  /** Width of the frames in pixels, even for raw_yuyv. */
+  uint32_t width;
+  /** Height of the frames in pixels. */
+  uint32_t height;
+  /** The raw_format_t of the frames. */
+  uint32_t format;
+  /** Bytes from the start of one frame to the next, a multiple of FRAME_ALIGN. */
+  uint32_t frame_size;
+  /** Number of frames in the file. */
+  uint32_t frame_count;
+  /** Padding, so fps is 8 byte aligned. */
+  uint32_t unused;
+  /** Frames per second the video was recorded at. */
+  double fps;
+  /** Padding out to FRAME_ALIGN bytes. */
+  char padding[FRAME_ALIGN - 40];
+} raw_video_header_t;
+
+/**
+ * @brief A struct that holds a raw video file mapped for reading.
+ */
+typedef struct {
+  /** The file's header, at the start of the mapping. */
+  const raw_video_header_t *header;
+  /** The whole file. */
+  const unsigned char *mapping;
+  /** Size of the mapping in bytes. */
+  size_t length;
+  /** Bytes in each row of a frame. */
+  size_t row_bytes;
+} raw_video_t;
+
+/**
+ * @brief A struct that holds a raw video file being recorded.
+ */
+typedef struct {
+  /** The file being written. */
+  FILE *file;
+  /** The header, written again with the final frame count when closed. */
+  raw_video_header_t header;
+  /** One frame in the file's format, padded to frame_size. */
+  unsigned char *buffer;
+} raw_video_writer_t;
+
+/**
+ * @brief Finds how many bytes each row of a frame takes.
+ * @param format The raw_format_t of the frames.
+ * @param width Width of the frames in pixels.
+ * @returns The bytes per row.
+ */
+size_t raw_row_bytes(uint32_t format, uint32_t width) {
+  return (size_t) width * (format == raw_yuyv ? 2 : 3);
+}
+
+/**
+ * @brief Maps a raw video file into memory.
+ * Exits if the file cannot be read or is not a whole raw video.
+ * @param path The file to map.
+ * @returns A pointer to the new raw_video_t struct.
+ */
+raw_video_t *open_raw_video(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd == -1 || fstat(fd, &info) == -1) {
+    perror("Unable to open raw video");
+    exit(EXIT_FAILURE);
+  }
+
+  raw_video_t *r = (raw_video_t *) malloc(sizeof(raw_video_t));
+  r->length = info.st_size;
+  void *mapping = r->length >= sizeof(raw_video_header_t)
+    ? mmap(NULL, r->length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    perror("Unable to map raw video");
+    exit(EXIT_FAILURE);
+  }
+  // The frames are read in order, so the kernel can read well ahead.
+  madvise(mapping, r->length, MADV_SEQUENTIAL);
+  r->mapping = (const unsigned char *) mapping;
+  r->header = (const raw_video_header_t *) mapping;
+  r->row_bytes = raw_row_bytes(r->header->format, r->header->width);
+
+  const raw_video_header_t *h = r->header;
+  if (memcmp(h->magic, RAW_VIDEO_MAGIC, sizeof(h->magic)) != 0 || h->format > raw_yuyv
+      || h->frame_size < r->row_bytes * h->height || h->frame_size % FRAME_ALIGN != 0
+      || sizeof(raw_video_header_t) + (size_t) h->frame_count * h->frame_size > r->length) {
+    fprintf(stderr, "%s is not a raw video\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return r;
+}
+
+/**
+ * @brief Gets a frame from a raw video, without copying it.
+ * @param r The raw video.
+ * @param index Which frame, from 0 to frame_count - 1.
+ * @returns A read only header over the frame in the mapping, CV_8UC3 for
+ *          raw_bgr or CV_8UC2 for raw_yuyv, valid until the video is closed.
+ */
+cv::Mat raw_video_frame(raw_video_t *r, uint32_t index) {
+  const unsigned char *frame = r->mapping + sizeof(raw_video_header_t) + (size_t) index * r->header->frame_size;
+  return cv::Mat(r->header->height, r->header->width, r->header->format == raw_yuyv ? CV_8UC2 : CV_8UC3,
+                 (void *) frame, r->row_bytes);
+}
+
+/**
+ * @brief Unmaps a raw video and frees the raw_video_t struct.
+ * @param r The raw video to close.
+ */
+void close_raw_video(raw_video_t *r) {
+  munmap((void *) r->mapping, r->length);
+  free(r);
+}
+
+/**
+ * @brief Clamps a colour channel to a byte.
+ */
+static inline unsigned char clamp_byte(int value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/**
+ * @brief Packs a BGR frame into YUYV with BT.601 studio range integer maths.
+ * Each pair of pixels shares the average of their chroma.
+ * @param bgr The frame, with an even width.
+ * @param yuyv Where to write the packed rows, raw_row_bytes apart.
+ */
+void pack_yuyv(const cv::Mat &bgr, unsigned char *yuyv) {
+  for (int y = 0; y < bgr.rows; y++) {
+    const unsigned char *src = bgr.ptr<unsigned char>(y);
+    unsigned char *dst = yuyv + (size_t) y * bgr.cols * 2;
+    for (int x = 0; x < bgr.cols; x += 2, src += 6, dst += 4) {
+      int b = src[0] + src[3];
+      int g = src[1] + src[4];
+      int r = src[2] + src[5];
+      dst[0] = clamp_byte(((66 * src[2] + 129 * src[1] + 25 * src[0] + 128) >> 8) + 16);
+      dst[2] = clamp_byte(((66 * src[5] + 129 * src[4] + 25 * src[3] + 128) >> 8) + 16);
+      dst[1] = clamp_byte(((-38 * r - 74 * g + 112 * b + 256) >> 9) + 128);
+      dst[3] = clamp_byte(((112 * r - 94 * g - 18 * b + 256) >> 9) + 128);
+    }
+  }
+}
+
+/**
+ * @brief Creates a raw video file to record frames into.
+ * @param path The file to write, replaced if it exists.
+ * @param width Width of the frames in pixels, must be even for raw_yuyv.
+ * @param height Height of the frames in pixels.
+ * @param format How to store the pixels.
+ * @param fps Frames per second the video is replayed at in real time.
+ * @returns A pointer to the new raw_video_writer_t struct.
+ */
+raw_video_writer_t *open_raw_writer(const char *path, int width, int height, raw_format_t format, double fps) {
+  if (format == raw_yuyv && width % 2 != 0) {
+    fprintf(stderr, "YUYV frames must have an even width\n");
+    exit(EXIT_FAILURE);
+  }
+  raw_video_writer_t *w = (raw_video_writer_t *) malloc(sizeof(raw_video_writer_t));
+  w->file = fopen(path, "wb");
+  if (!w->file) {
+    perror("Unable to create raw video");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&w->header, 0, sizeof(w->header));
+  memcpy(w->header.magic, RAW_VIDEO_MAGIC, sizeof(w->header.magic));
+  w->header.width = width;
+  w->header.height = height;
+  w->header.format = format;
+  size_t bytes = raw_row_bytes(format, width) * height;
+  w->header.frame_size = (bytes + FRAME_ALIGN - 1) / FRAME_ALIGN * FRAME_ALIGN;
+  w->header.frame_count = 0;
+  w->header.fps = fps;
+  w->buffer = (unsigned char *) calloc(w->header.frame_size, 1);
+
+  if (fwrite(&w->header, sizeof(w->header), 1, w->file) != 1) {
+    perror("Unable to write raw video");
+    exit(EXIT_FAILURE);
+  }
+  return w;
+}
+
+/**
+ * @brief Appends a frame to a raw video.
+ * @param w The raw video being recorded.
+ * @param frame A BGR frame the size given to open_raw_writer.
+ */
+void write_raw_frame(raw_video_writer_t *w, const cv::Mat &frame) {
+  if (frame.cols != (int) w->header.width || frame.rows != (int) w->header.height || frame.type() != CV_8UC3) {
+    fprintf(stderr, "Frames must all be the same size\n");
+    exit(EXIT_FAILURE);
+  }
+  if (w->header.format == raw_yuyv) {
+    pack_yuyv(frame, w->buffer);
+  } else {
+    size_t row_bytes = raw_row_bytes(raw_bgr, frame.cols);
+    for (int y = 0; y < frame.rows; y++) {
+      memcpy(w->buffer + y * row_bytes, frame.ptr<unsigned char>(y), row_bytes);
+    }
+  }
+  if (fwrite(w->buffer, w->header.frame_size, 1, w->file) != 1) {
+    perror("Unable to write raw video");
+    exit(EXIT_FAILURE);
+  }
+  w->header.frame_count++;
+}
+
+/**
+ * @brief Finishes a raw video and frees the raw_video_writer_t struct.
+ * @param w The raw video being recorded.
+ * @param fps Frames per second to record in the header, 0 to keep the one it was opened with.
+ */
+void close_raw_writer(raw_video_writer_t *w, double fps) {
+  if (fps > 0) {
+    w->header.fps = fps;
+  }
+  if (fseek(w->file, 0, SEEK_SET) != 0 || fwrite(&w->header, sizeof(w->header), 1, w->file) != 1
+      || fclose(w->file) != 0) {
+    perror("Unable to write raw video");
+    exit(EXIT_FAILURE);
+  }
+  free(w->buffer);
+  free(w);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file record_raw.cpp
+ * @brief Records frames from any frame source into a raw video, for decode free replay.
+ */
+
+#include <unistd.h>
+#include "cv.h"
+#include "highgui.h"
+#include "thread_pool.c"
+#include "frame_pool.c"
+#include "raw_video.c"
+#include "frame_source.c"
+
+/** Frames recorded from a webcam when no count is given, 10 seconds. */
+#define DEFAULT_CAMERA_FRAMES 300
+
+/**
+ * @brief Prints how to run the program, then exits.
+ * @param name The name the program was run with.
+ */
+void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-y] [-n frames] source output.raw\n", name);
+  fprintf(stderr, "  -y  Store the frames as YUYV, 2 bytes a pixel, instead of BGR, 3 bytes\n");
+  fprintf(stderr, "      a pixel. BGR frames are replayed without any conversion.\n");
+  fprintf(stderr, "  -n  Number of frames to record. Defaults to the whole of a recorded\n");
+  fprintf(stderr, "      source, or %d frames from a webcam.\n", DEFAULT_CAMERA_FRAMES);
+  fprintf(stderr, "The source is anything -i accepts: camera, camera:N, a video file, a\n");
+  fprintf(stderr, "directory of images or another raw video.\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  raw_format_t format = raw_bgr;
+  long limit = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "yn:")) != -1) {
+    switch (opt) {
+      case 'y':
+        format = raw_yuyv;
+        break;
+      case 'n':
+        limit = atol(optarg);
+        if (limit <= 0) {
+          usage(argv[0]);
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2) {
+    usage(argv[0]);
+  }
+
+  frame_source_t *source = open_frame_source(argv[optind], false);
+  if (limit == 0 && source->type == source_camera) {
+    limit = DEFAULT_CAMERA_FRAMES;
+  }
+
+  raw_video_writer_t *writer = NULL;
+  long frames = 0;
+  double start = 0;
+  while (limit == 0 || frames < limit) {
+    cv::Mat frame = read_frame(source);
+    if (frame.empty()) {
+      if (source->finished) {
+        break;
+      }
+      usleep(1000);
+      continue;
+    }
+    if (!writer) {
+      writer = open_raw_writer(argv[optind + 1], frame.cols, frame.rows, format, source->fps);
+      start = monotonic_seconds();
+    }
+    write_raw_frame(writer, frame);
+    frames++;
+  }
+
+  if (!writer) {
+    fprintf(stderr, "No frames to record\n");
+    return EXIT_FAILURE;
+  }
+  // Webcams rarely report their rate, so it is measured instead.
+  double elapsed = monotonic_seconds() - start;
+  double fps = source->type == source_camera && frames > 1 && elapsed > 0 ? (frames - 1) / elapsed : 0;
+  close_raw_writer(writer, fps);
+  printf("Recorded %ld frames.\n", frames);
+  close_frame_source(source);
+  free_frame_pool();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file scheduler.c
+ * @brief A fixed timestep game loop scheduler on a monotonic clock.
+ */
+
+/** Most game updates run in one go when the loop has fallen behind. */
+#define MAX_CATCH_UP_TICKS 5
+
+/**
+ * @brief A struct that holds when the game should next update and render.
+ * The game state advances in fixed steps of tick seconds however long each
+ * loop iteration takes, so the game runs at the same speed whatever the
+ * camera and vision cost. Rendering has its own rate and only ever shows the
+ * latest state. All times are CLOCK_MONOTONIC seconds, as from
+ * monotonic_seconds, and are passed in so the scheduler can be tested.
+ */
+typedef struct {
+  /** Seconds of game time each update covers. */
+  double tick;
+  /** Seconds between renders, 0 to render after every update. */
+  double render_interval;
+  /** Time not yet covered by an update. */
+  double accumulator;
+  /** When the accumulator was last advanced. */
+  double last_time;
+  /** When the game was last rendered. */
+  double last_render;
+  /** Updates run so far. */
+  long ticks;
+  /** Updates skipped because the loop fell more than MAX_CATCH_UP_TICKS behind. */
+  long skipped_ticks;
+  /** Renders so far. */
+  long renders;
+  /** Longest time between two renders, in seconds. */
+  double worst_render_gap;
+  /** Sum of the times between renders, for the mean. */
+  double total_render_gap;
+} scheduler_t;
+
+/**
+ * @brief Initialises the scheduler_t struct.
+ * @param tick Seconds of game time each update covers.
+ * @param render_interval Seconds between renders, 0 to render after every update.
+ * @param now The current time.
+ * @returns A pointer to the new scheduler_t struct.
+ */
+scheduler_t *init_scheduler(double tick, double render_interval, double now) {
+  scheduler_t *s = (scheduler_t *) malloc(sizeof(scheduler_t));
+  s->tick = tick;
+  s->render_interval = render_interval;
+  s->accumulator = 0;
+  s->last_time = now;
+  s->last_render = now;
+  s->ticks = 0;
+  s->skipped_ticks = 0;
+  s->renders = 0;
+  s->worst_render_gap = 0;
+  s->total_render_gap = 0;
+  return s;
+}
+
+/**
+ * @brief Works out how many game updates are due.
+ * Each update that is returned must be run before the next call. When more
+ * than MAX_CATCH_UP_TICKS are due, such as after a long stall, only that many
+ * are returned and the rest are dropped, so the game slows down for a moment
+ * rather than running ever further behind.
+ * @param s The scheduler.
+ * @param now The current time.
+ * @returns The number of updates to run.
+ */
+int scheduler_ticks(scheduler_t *s, double now) {
+  s->accumulator += now - s->last_time;
+  s->last_time = now;
+
+  int ticks = (int) (s->accumulator / s->tick);
+  if (ticks > MAX_CATCH_UP_TICKS) {
+    s->skipped_ticks += ticks - MAX_CATCH_UP_TICKS;
+    s->accumulator -= (ticks - MAX_CATCH_UP_TICKS) * s->tick;
+    ticks = MAX_CATCH_UP_TICKS;
+  }
+  s->accumulator -= ticks * s->tick;
+  s->ticks += ticks;
+  return ticks;
+}
+
+/**
+ * @brief Checks whether it is time to render, and records the frame if so.
+ * @param s The scheduler.
+ * @param now The current time.
+ * @param updated Whether an update has run since the last render.
+ * @returns True iff the game should be rendered now.
+ */
+bool scheduler_render(scheduler_t *s, double now, bool updated) {
+  if (s->render_interval == 0 ? !updated : now - s->last_render < s->render_interval) {
+    return false;
+  }
+
+  double gap = now - s->last_render;
+  if (s->renders > 0) {
+    s->total_render_gap += gap;
+    s->worst_render_gap = gap > s->worst_render_gap ? gap : s->worst_render_gap;
+  }
+  s->last_render = now;
+  s->renders++;
+  return true;
+}
+
+/**
+ * @brief Finds how long until the scheduler next has something to do.
+ * @param s The scheduler.
+ * @param now The current time.
+ * @returns The seconds until the next update or render is due, 0 if one already is.
+ */
+double scheduler_timeout(scheduler_t *s, double now) {
+  double next = s->tick - s->accumulator - (now - s->last_time);
+  if (s->render_interval > 0) {
+    double render = s->render_interval - (now - s->last_render);
+    next = render < next ? render : next;
+  }
+  return next > 0 ? next : 0;
+}
+
+/**
+ * @brief Prints how many updates ran and how evenly the game was rendered.
+ * @param s The scheduler.
+ */
+void print_scheduler_stats(scheduler_t *s) {
+  printf("Ran %ld game updates (%ld skipped catching up), rendered %ld frames",
+         s->ticks, s->skipped_ticks, s->renders);
+  if (s->renders > 1) {
+    printf(", %.1fms apart on average and %.1fms at worst",
+           1000 * s->total_render_gap / (s->renders - 1), 1000 * s->worst_render_gap);
+  }
+  printf(".\n");
+}
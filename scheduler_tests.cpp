@@ -0,0 +1,81 @@
+/**
+ * @file scheduler_tests.cpp
+ * @brief Tests for the game loop scheduler.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "scheduler.c"
+
+typedef void test_t(void);
+
+void run_test(test_t test) {
+  printf("Running tests: ");
+  test();
+  printf("Passed!\n");
+}
+
+void test_fixed_ticks(void) {
+  printf("fixed_ticks\n");
+  scheduler_t *s = init_scheduler(0.05, 0, 100);
+
+  // However the loop iterations are spread, a second is always 20 updates.
+  // The run ends just past a tick so rounding cannot move the last one.
+  double steps[] = {0.001, 0.03, 0.07, 0.011, 0.2, 0.049, 0.051, 0.0005};
+  double now = 100;
+  int ticks = 0;
+  for (int i = 0; now < 101.01; i++) {
+    double step = steps[i % 8];
+    now = now + step > 101.01 ? 101.01 : now + step;
+    ticks += scheduler_ticks(s, now);
+  }
+  assert(ticks == 20);
+  assert(s->skipped_ticks == 0);
+  free(s);
+}
+
+void test_catch_up_limit(void) {
+  printf("catch_up_limit\n");
+  scheduler_t *s = init_scheduler(0.01, 0, 0);
+
+  // A stall of a second only runs a few updates, and drops the rest.
+  assert(scheduler_ticks(s, 1.0005) == MAX_CATCH_UP_TICKS);
+  assert(s->skipped_ticks == 100 - MAX_CATCH_UP_TICKS);
+  assert(scheduler_ticks(s, 1.0005) == 0);
+  assert(scheduler_ticks(s, 1.0106) == 1);
+  free(s);
+}
+
+void test_render_rate(void) {
+  printf("render_rate\n");
+  scheduler_t *s = init_scheduler(0.01, 1.0 / 30, 0);
+
+  int renders = 0;
+  for (int i = 1; i <= 1000; i++) {
+    double now = i * 0.001;
+    scheduler_ticks(s, now);
+    renders += scheduler_render(s, now, true);
+    assert(scheduler_timeout(s, now) <= 0.01);
+  }
+  assert(renders >= 29 && renders <= 30);
+  assert(s->worst_render_gap < 1.0 / 30 + 0.0011);
+
+  // At a rate of 0, a frame is rendered after each update and only then.
+  scheduler_t *every = init_scheduler(0.01, 0, 0);
+  assert(!scheduler_render(every, 0.005, scheduler_ticks(every, 0.005) > 0));
+  assert(scheduler_render(every, 0.012, scheduler_ticks(every, 0.012) > 0));
+  assert(fabs(scheduler_timeout(every, 0.012) - 0.008) < 1e-9);
+  free(s);
+  free(every);
+}
+
+int main(int argc, char **argv) {
+  printf("Running tests:\n");
+  run_test(test_fixed_ticks);
+  run_test(test_catch_up_limit);
+  run_test(test_render_rate);
+  printf("All passed!\n");
+  return EXIT_SUCCESS;
+}
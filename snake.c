@@ -10,219 +10,22 @@
 #include <stdlib.h>
 #include <ncurses.h>
 
-#define EMPTY_SPACE ' '
+#include "flappy-bird/object_list.c"
+
 #define WIDTH 50
 #define HEIGHT 50
-#define INITIAL_OBJECT_LIST_SIZE 20
-
-typedef struct {
-  char *ascii;
-  int color;
-  uint16_t height;
-  uint16_t width;
-} ascii_t;
-
-typedef enum {
-  bird,
-  pipes,
-  cloud,
-  ground,
-  snake_head,
-  snake_body,
-  snake_tail,
-  snake_apple,
-} type_t;
-
-typedef struct {
-  int16_t x;
-  int16_t y;
-} vector_t;
-
-typedef struct object_list_elem object_list_elem_t;
-
-struct object_list_elem {
-  type_t type;
-  vector_t point;
-  vector_t velocity;
-  vector_t acceleration;
-  ascii_t *ascii;
-  uint16_t depth;
-  struct object_list_elem *prev;
-};
-
-
-typedef struct {
-  object_list_elem_t **array;
-  uint16_t size;
-  uint16_t max_size;
-} object_list_t;
-
 
 static char snake[] = "&";
 
 static char char_apple[] = "@";
 
-typedef void object_list_elem_function_t(object_list_elem_t *);
-
-
 int snake_hit(object_list_t *list);
 object_list_t *init_game(void);
 void move_snake(object_list_t *list, vector_t dir);
-void render_game(object_list_t *list, vector_t dir);
+void update_game(object_list_t *list, vector_t dir);
+void render_game(object_list_t *list);
 void hit_apple(object_list_t *list);
 
-object_list_t *new_list(void);
-void remove_elem(object_list_t *list, uint16_t id);
-void add_elem(object_list_t *list, object_list_elem_t *elem);
-int is_covering (object_list_elem_t *elem, vector_t point);
-char get_char_ascii(ascii_t *ascii, vector_t point);
-char get_char_list(object_list_t *list, vector_t point);
-void for_all(object_list_t *list, object_list_elem_function_t function);
-void move_object(object_list_elem_t *elem);
-void print_object(object_list_elem_t *elem);
-int get_color(object_list_t *list, vector_t point);
-void print_game(object_list_t *list, int width, int height);
-void free_object_list(object_list_t *list);
-void free_object_list_elem(object_list_elem_t *elem);
-object_list_elem_t *get_elem(object_list_t *list, type_t type);
-
-int compare_list_elem(const void *a, const void *b) {
-  object_list_elem_t *object_a = (object_list_elem_t*) a;
-  object_list_elem_t *object_b = (object_list_elem_t*) b ;
-
-  if (object_a->depth == object_b->depth) {
-    return 0;
-  } else if (object_a->depth < object_b->depth) {
-    return -1;
-  } else {
-    return 1;
-  }
-}
-
-object_list_t *new_list(void) {
-  object_list_t *list = (object_list_t *) malloc(sizeof(object_list_t));
-  if (!list) {
-    perror("Unable to allocate memory for new list");
-    exit(EXIT_FAILURE);
-  }
-  list->array = (object_list_elem_t **) malloc(sizeof(object_list_elem_t *) * INITIAL_OBJECT_LIST_SIZE);
-  if (!list->array) {
-    perror("Unable to allocate memory for new list");
-    exit(EXIT_FAILURE);
-  }
-  list->size = 0;
-  list->max_size = INITIAL_OBJECT_LIST_SIZE;
-  return list;
-}
-
-void add_elem(object_list_t *list, object_list_elem_t *elem) {
-  if (list->size >= list->max_size) {
-    list->max_size *= 2;
-    list->array = (object_list_elem_t **) realloc(list->array, sizeof(object_list_elem_t *) * list->max_size);
-    if (!list->array) {
-      perror("Unable to reallocate memory for object list");
-      exit(EXIT_FAILURE);
-    }
-  }
-  list->array[list->size] = elem;
-  list->size++;
-  // qsort(list->array[0], list->size, sizeof(object_list_elem_t*), compare_list_elem);
-}
-
-int is_covering (object_list_elem_t *elem, vector_t point) {
-  if ((elem->point.x <= point.x) && ((elem->point.x + elem->ascii->width) > point.x)) {
-    if ((elem->point.y <= point.y) && ((elem->point.y + elem->ascii->height) > point.y)) {
-      return 1;
-    }
-  }
-  return 0;
-}
-
-char get_char_ascii(ascii_t *ascii, vector_t point) {
-  return ascii->ascii[point.y * ascii->width + point.x];
-}
-
-char get_char_list(object_list_t *list, vector_t point) {
-  for (int i = 0; i < list->size; i++) {
-    if (is_covering(list->array[i], point)) {
-      point.x -= list->array[i]->point.x;
-      point.y -= list->array[i]->point.y;
-      return get_char_ascii(list->array[i]->ascii, point);
-    }
-  }
-  return EMPTY_SPACE;
-}
-
-void for_all(object_list_t *list, object_list_elem_function_t function) {
-  for (int i = 0; i < list->size; i++) {
-    function(list->array[i]);
-  }
-}
-
-void move_object(object_list_elem_t *elem) {
-  elem->point.x += elem->velocity.x;
-  elem->point.y += elem->velocity.y;
-  elem->velocity.x += elem->acceleration.x;
-  elem->velocity.y += elem->acceleration.y;
-}
-
-void print_object(object_list_elem_t *elem) {
-  printf("\nObject type: %d\n", elem->type);
-  printf("Has:\n");
-  printf("Depth: %d\n", elem->depth);
-  printf("Position: (%d, %d)\n", elem->point.x, elem->point.y);
-  // printf("Velocity: (%d, %d)\n", elem->velocity.x, elem->velocity.y);
-  printf("Char at 0, 0: %c\n", get_char_ascii(elem->ascii, (vector_t) {0, 0}));
-}
-
-object_list_elem_t *get_elem(object_list_t *list, type_t type) {
-  for (int i = 0; i < list->size; i++) {
-    if (list->array[i]->type == type) {
-      return list->array[i];
-    }
-  }
-  return NULL;
-}
-
-
-int get_color(object_list_t *list, vector_t point) {
-  for (int i = 0; i < list->size; i++) {
-    if (is_covering(list->array[i], point)) {
-      return list->array[i]->ascii->color;
-    }
-  }
-  return 1;
-}
-
-void print_game(object_list_t *list, int width, int height) {
-  for (int i = 0; i < height; i++) {
-    for (int j = 0; j < width; j++) {
-      vector_t point = {j, i};
-      int color = get_color(list, point);
-      char c = get_char_list(list, point);
-      if (c == ' ') {
-        color*=2;
-      }
-      attron(COLOR_PAIR(color));
-      addch(c);
-    }
-    printw("\n");
-  }
-}
-
-void free_object_list(object_list_t *list) {
-  for_all(list, free_object_list_elem);
-  free(list->array);
-  free(list);
-}
-
-void free_object_list_elem(object_list_elem_t *elem) {
-  if (elem->ascii != NULL) {
-    free(elem->ascii);
-  }
-  free(elem);
-}
-
 
 /**
  * @brief Initailises a game state for a snake game.
@@ -294,9 +97,9 @@ object_list_t *init_game(void) {
   for_all(objects, print_object);
 
   cbreak();
-  initscr();
+  init_screen();
   noecho();
-  timeout(1);
+  timeout(0);
 
   start_color();
   init_pair(1, COLOR_WHITE, COLOR_BLUE);
@@ -361,17 +164,24 @@ void hit_apple(object_list_t *list) {
 }
 
 /**
- * @brief Renders the game, and updates the game state.
+ * @brief Updates the game state by one step.
  *
  * @param list The object list.
  * @param dir Direction for the snake head to go.
  */
-void render_game(object_list_t *list, vector_t dir) {
-  clear();
+void update_game(object_list_t *list, vector_t dir) {
   move_snake(list, dir);
   hit_apple(list);
+}
+
+/**
+ * @brief Renders the game.
+ *
+ * @param list The object list.
+ */
+void render_game(object_list_t *list) {
+  move(0, 0);
   print_game(list, WIDTH, HEIGHT);
-  refresh();
 }
 
 /**
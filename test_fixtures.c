@@ -0,0 +1,57 @@
+/**
+ * @file test_fixtures.c
+ * @brief Calibrations and frames shared by the tests and the benchmarks.
+ */
+
+/** Width of the test frames. */
+#define TEST_WIDTH 320
+/** Height of the test frames. */
+#define TEST_HEIGHT 240
+
+/**
+ * @brief Makes a calibration that takes the colour of the generated skin discs as skin.
+ * @returns A pointer to the new calibration_t struct, freed with free_calibration.
+ */
+calibration_t *make_test_calibration(void) {
+  calibration_t *c = init_calibration();
+  c->h_min = 0;
+  c->h_max = 20;
+  c->s_min = 50;
+  c->s_max = 255;
+  c->v_min = 50;
+  c->v_max = 255;
+  return c;
+}
+
+/**
+ * @brief Makes a black frame with a white disc for each hand.
+ */
+cv::Mat make_hands_frame(int left_x, int left_y, int right_x, int right_y, int radius) {
+  cv::Mat frame(TEST_HEIGHT, TEST_WIDTH, CV_8UC1);
+  for (int y = 0; y < frame.rows; y++) {
+    for (int x = 0; x < frame.cols; x++) {
+      bool in_left = dist(x, y, left_x, left_y) < radius;
+      bool in_right = dist(x, y, right_x, right_y) < radius;
+      frame.at<unsigned char>(y, x) = in_left || in_right ? 255 : 0;
+    }
+  }
+  return frame;
+}
+
+/**
+ * @brief Makes a blue BGR frame with a skin coloured disc for each hand.
+ */
+cv::Mat make_colour_frame(int left_x, int left_y, int right_x, int right_y, int radius) {
+  cv::Mat mask = make_hands_frame(left_x, left_y, right_x, right_y, radius);
+  cv::Mat frame(mask.rows, mask.cols, CV_8UC3);
+  for (int y = 0; y < frame.rows; y++) {
+    for (int x = 0; x < frame.cols; x++) {
+      unsigned char *p = frame.ptr<unsigned char>(y) + 3 * x;
+      bool is_skin = mask.at<unsigned char>(y, x) != 0;
+      p[0] = is_skin ? 60 : 200;
+      p[1] = is_skin ? 100 : 80;
+      p[2] = is_skin ? 200 : 40;
+    }
+  }
+  return frame;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file thread_pool.c
+ * @brief A persistent pool of worker threads that run stages in row bands.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+/** The most bands a stage is ever split into. */
+#define MAX_BANDS 64
+/** The fewest rows worth giving a band of their own. */
+#define MIN_BAND_ROWS 16
+
+/**
+ * @brief A function that processes one band of rows.
+ * @param start The first row of the band.
+ * @param end One past the last row of the band.
+ * @param band The index of the band, for per band results.
+ * @param arg The stage's arguments.
+ */
+typedef void band_function_t(int start, int end, int band, void *arg);
+
+/**
+ * @brief A struct that holds the worker threads and the stage they are running.
+ */
+typedef struct {
+  /** The worker threads, one fewer than the thread count. */
+  pthread_t *workers;
+  /** Number of threads running bands, including the caller of run_bands. */
+  int thread_count;
+  /** Guards everything below. */
+  pthread_mutex_t lock;
+  /** Signalled when a new stage is started or the pool is stopping. */
+  pthread_cond_t work_ready;
+  /** Signalled when the last band of a stage is done. */
+  pthread_cond_t work_done;
+  /** Counts the stages started, so workers can tell a new one has begun. */
+  unsigned long generation;
+  /** The function of the current stage. */
+  band_function_t *function;
+  /** The arguments of the current stage. */
+  void *arg;
+  /** Number of rows in the current stage. */
+  int rows;
+  /** Number of bands the current stage is split into. */
+  int bands;
+  /** The next band that has not been claimed by a thread. */
+  int next_band;
+  /** Number of bands that have finished. */
+  int bands_done;
+  /** True when the workers should exit. */
+  bool stopping;
+} thread_pool_t;
+
+/** The pool shared by all the vision stages, runs everything inline until started. */
+static thread_pool_t thread_pool = {NULL, 1};
+
+/**
+ * @brief Runs bands of the current stage until none are left unclaimed.
+ * Must be called with the lock held, which is released while a band runs.
+ * @param p The pool.
+ */
+void run_claimed_bands(thread_pool_t *p) {
+  while (p->next_band < p->bands) {
+    int band = p->next_band++;
+    int start = (long) p->rows * band / p->bands;
+    int end = (long) p->rows * (band + 1) / p->bands;
+    band_function_t *function = p->function;
+    void *arg = p->arg;
+
+    pthread_mutex_unlock(&p->lock);
+    function(start, end, band, arg);
+    pthread_mutex_lock(&p->lock);
+
+    if (++p->bands_done == p->bands) {
+      pthread_cond_signal(&p->work_done);
+    }
+  }
+}
+
+/**
+ * @brief The loop each worker thread runs, waiting for stages to help with.
+ * @param data Unused.
+ * @returns NULL once the pool is stopping.
+ */
+void *thread_pool_worker(void *data) {
+  thread_pool_t *p = &thread_pool;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&p->lock);
+  while (true) {
+    while (p->generation == seen && !p->stopping) {
+      pthread_cond_wait(&p->work_ready, &p->lock);
+    }
+    if (p->stopping) {
+      break;
+    }
+    seen = p->generation;
+    run_claimed_bands(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+
+  return NULL;
+}
+
+/**
+ * @brief Starts the worker threads.
+ * @param threads The number of threads to run bands on, including the caller,
+ *                or 0 for one per online core.
+ */
+void init_thread_pool(int threads) {
+  thread_pool_t *p = &thread_pool;
+
+  if (threads <= 0) {
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (threads > MAX_BANDS) {
+    threads = MAX_BANDS;
+  }
+
+  p->thread_count = threads;
+  p->generation = 0;
+  p->stopping = false;
+  p->bands = 0;
+  p->next_band = 0;
+  p->bands_done = 0;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work_ready, NULL);
+  pthread_cond_init(&p->work_done, NULL);
+
+  p->workers = (pthread_t *) malloc(sizeof(pthread_t) * (threads - 1));
+  for (int i = 0; i < threads - 1; i++) {
+    if (pthread_create(&p->workers[i], NULL, thread_pool_worker, NULL)) {
+      perror("Unable to start worker thread");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/**
+ * @brief Stops the worker threads, after which stages run inline again.
+ */
+void free_thread_pool(void) {
+  thread_pool_t *p = &thread_pool;
+  if (!p->workers) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->stopping = true;
+  pthread_cond_broadcast(&p->work_ready);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->thread_count - 1; i++) {
+    pthread_join(p->workers[i], NULL);
+  }
+  free(p->workers);
+  p->workers = NULL;
+  p->thread_count = 1;
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->work_ready);
+  pthread_cond_destroy(&p->work_done);
+}
+
+/**
+ * @brief Picks how many bands to split a stage into.
+ * One band per thread, but never so many that a band is shorter than
+ * min_rows, as waking a thread costs more than a few short rows.
+ * @param rows The number of rows in the stage.
+ * @param min_rows The fewest rows worth giving a band.
+ * @returns The number of bands, at least 1 and at most MAX_BANDS.
+ */
+int band_count(int rows, int min_rows) {
+  int bands = thread_pool.thread_count;
+  if (bands > rows / min_rows) {
+    bands = rows / min_rows;
+  }
+  return bands < 1 ? 1 : bands;
+}
+
+/**
+ * @brief Runs a stage over rows split into bands, on the pool's threads.
+ * Band b covers rows [rows * b / bands, rows * (b + 1) / bands), so which
+ * rows each band gets does not depend on the thread that runs it, and stages
+ * that combine per band results in band order are deterministic. Returns
+ * once every band is done.
+ * @param rows The number of rows.
+ * @param bands The number of bands, from band_count.
+ * @param function The function that processes a band.
+ * @param arg The arguments passed to function.
+ */
+void run_bands(int rows, int bands, band_function_t *function, void *arg) {
+  thread_pool_t *p = &thread_pool;
+
+  if (!p->workers || bands <= 1) {
+    for (int band = 0; band < bands; band++) {
+      function((long) rows * band / bands, (long) rows * (band + 1) / bands, band, arg);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->function = function;
+  p->arg = arg;
+  p->rows = rows;
+  p->bands = bands;
+  p->next_band = 0;
+  p->bands_done = 0;
+  p->generation++;
+  pthread_cond_broadcast(&p->work_ready);
+
+  run_claimed_bands(p);
+  while (p->bands_done < p->bands) {
+    pthread_cond_wait(&p->work_done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
@@ -3,6 +3,35 @@
  * @brief Functions to determine skin-coloured pixel within a frame.
  */
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define THRESHOLD_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief The accepted values of one channel, as the union of two intervals.
+ * Storing the wrap-around case of in_range as a second interval (and the
+ * normal case with an empty second interval) lets every kernel test a pixel
+ * without branching on the calibration.
+ */
+typedef struct {
+  /** The lower bounds of the two intervals. */
+  unsigned char lo[2];
+  /** The upper bounds of the two intervals. */
+  unsigned char hi[2];
+} channel_range_t;
+
+/**
+ * @brief A function that thresholds one row of HSV pixels into mask bytes.
+ * @param src The first pixel of the row.
+ * @param dst The first mask byte of the row.
+ * @param width The number of pixels in the row.
+ * @param channels The number of bytes per pixel.
+ * @param ranges The H, S and V ranges to accept.
+ */
+typedef void threshold_row_function_t(const unsigned char *src, unsigned char *dst, int width,
+                                      int channels, const channel_range_t *ranges);
+
 /**
  * @brief Checks whether a given value is in a given range.
  * Note that the minimum and maximum values can sometimes be swapped due to the
@@ -21,32 +50,450 @@ bool in_range(unsigned char value, unsigned char min, unsigned char max, unsigne
   }
 }
 
+/**
+ * @brief Builds the two-interval form of an in_range test.
+ * @param r The channel range to fill in.
+ * @param min Normally the minimum value to accept.
+ * @param max Normally the maximum value to accept.
+ * @param range The maximum value that is allowed.
+ */
+void set_channel_range(channel_range_t *r, unsigned char min, unsigned char max, unsigned char range) {
+  if (max >= min) {
+    r->lo[0] = min;
+    r->hi[0] = max;
+    // An empty interval, nothing is both >= 1 and <= 0.
+    r->lo[1] = 1;
+    r->hi[1] = 0;
+  } else {
+    r->lo[0] = 0;
+    r->hi[0] = min;
+    r->lo[1] = max;
+    r->hi[1] = range;
+  }
+}
+
+/**
+ * @brief Builds the H, S and V channel ranges of a calibration.
+ * @param c The calibration which contains the skin colour.
+ * @param ranges The 3 channel ranges to fill in.
+ */
+void set_calibration_ranges(calibration_t *c, channel_range_t *ranges) {
+  set_channel_range(&ranges[0], c->h_min, c->h_max, 180);
+  set_channel_range(&ranges[1], c->s_min, c->s_max, 255);
+  set_channel_range(&ranges[2], c->v_min, c->v_max, 255);
+}
+
+/**
+ * @brief Thresholds a row one pixel at a time, works for any channel count.
+ */
+void threshold_row_scalar(const unsigned char *src, unsigned char *dst, int width,
+                          int channels, const channel_range_t *ranges) {
+  for (int x = 0; x < width; x++) {
+    int in = 1;
+    for (int w = 0; w < 3; w++) {
+      unsigned char v = src[x * channels + w];
+      in &= ((v >= ranges[w].lo[0]) & (v <= ranges[w].hi[0])) | ((v >= ranges[w].lo[1]) & (v <= ranges[w].hi[1]));
+    }
+    dst[x] = (unsigned char) -in;
+  }
+}
+
+#ifdef THRESHOLD_X86
+
+/**
+ * @brief Thresholds 16 pixels per iteration using SSE4.1.
+ * The 48 interleaved bytes are split into H, S and V vectors with pshufb, and
+ * the unsigned comparisons are done with min/max followed by an equality test.
+ */
+__attribute__((target("sse4.1")))
+void threshold_row_sse41(const unsigned char *src, unsigned char *dst, int width,
+                         int channels, const channel_range_t *ranges) {
+  const __m128i shuffle[3][3] = {
+    {_mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+     _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1),
+     _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)},
+    {_mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+     _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1),
+     _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)},
+    {_mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+     _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1),
+     _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)},
+  };
+  __m128i lo[3][2];
+  __m128i hi[3][2];
+  for (int w = 0; w < 3; w++) {
+    for (int i = 0; i < 2; i++) {
+      lo[w][i] = _mm_set1_epi8((char) ranges[w].lo[i]);
+      hi[w][i] = _mm_set1_epi8((char) ranges[w].hi[i]);
+    }
+  }
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (src + x * 3));
+    __m128i b = _mm_loadu_si128((const __m128i *) (src + x * 3 + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *) (src + x * 3 + 32));
+    __m128i result = _mm_set1_epi8(-1);
+
+    for (int w = 0; w < 3; w++) {
+      __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, shuffle[w][0]),
+                                            _mm_shuffle_epi8(b, shuffle[w][1])),
+                               _mm_shuffle_epi8(c, shuffle[w][2]));
+      __m128i in0 = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo[w][0]), v),
+                                  _mm_cmpeq_epi8(_mm_min_epu8(v, hi[w][0]), v));
+      __m128i in1 = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo[w][1]), v),
+                                  _mm_cmpeq_epi8(_mm_min_epu8(v, hi[w][1]), v));
+      result = _mm_and_si128(result, _mm_or_si128(in0, in1));
+    }
+
+    _mm_storeu_si128((__m128i *) (dst + x), result);
+  }
+
+  threshold_row_scalar(src + x * 3, dst + x, width - x, 3, ranges);
+}
+
+/**
+ * @brief Thresholds 32 pixels per iteration using AVX2.
+ * pshufb only shuffles within a 128 bit lane, so the 96 bytes are loaded such
+ * that the low lane holds pixels 0-15 and the high lane pixels 16-31, letting
+ * both lanes share the SSE4.1 shuffle masks.
+ */
+__attribute__((target("avx2")))
+void threshold_row_avx2(const unsigned char *src, unsigned char *dst, int width,
+                        int channels, const channel_range_t *ranges) {
+  const __m256i shuffle[3][3] = {
+    {_mm256_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+     _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1,
+                      -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1),
+     _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13,
+                      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)},
+    {_mm256_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+     _mm256_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1,
+                      -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1),
+     _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14,
+                      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)},
+    {_mm256_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+     _mm256_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1,
+                      -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1),
+     _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15,
+                      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)},
+  };
+  __m256i lo[3][2];
+  __m256i hi[3][2];
+  for (int w = 0; w < 3; w++) {
+    for (int i = 0; i < 2; i++) {
+      lo[w][i] = _mm256_set1_epi8((char) ranges[w].lo[i]);
+      hi[w][i] = _mm256_set1_epi8((char) ranges[w].hi[i]);
+    }
+  }
+
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const unsigned char *p = src + x * 3;
+    __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) p)),
+                                        _mm_loadu_si128((const __m128i *) (p + 48)), 1);
+    __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (p + 16))),
+                                        _mm_loadu_si128((const __m128i *) (p + 64)), 1);
+    __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (p + 32))),
+                                        _mm_loadu_si128((const __m128i *) (p + 80)), 1);
+    __m256i result = _mm256_set1_epi8(-1);
+
+    for (int w = 0; w < 3; w++) {
+      __m256i v = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, shuffle[w][0]),
+                                                   _mm256_shuffle_epi8(b, shuffle[w][1])),
+                                  _mm256_shuffle_epi8(c, shuffle[w][2]));
+      __m256i in0 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, lo[w][0]), v),
+                                     _mm256_cmpeq_epi8(_mm256_min_epu8(v, hi[w][0]), v));
+      __m256i in1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, lo[w][1]), v),
+                                     _mm256_cmpeq_epi8(_mm256_min_epu8(v, hi[w][1]), v));
+      result = _mm256_and_si256(result, _mm256_or_si256(in0, in1));
+    }
+
+    _mm256_storeu_si256((__m256i *) (dst + x), result);
+  }
+
+  threshold_row_sse41(src + x * 3, dst + x, width - x, 3, ranges);
+}
+
+#endif
+
+/** The row kernel chosen for this CPU by init_threshold. */
+static threshold_row_function_t *threshold_row = NULL;
+
+/** Fixed point precision of the BGR to HSV conversion, as used by OpenCV. */
+#define HSV_SHIFT 12
+/** Number of pixels get_arm_bgr converts to HSV before thresholding them. */
+#define HSV_CHUNK 256
+
+/** Reciprocal table for the saturation, 255 / v in fixed point. */
+static int hsv_sdiv_table[256];
+/** Reciprocal table for the hue, 180 / (6 * diff) in fixed point. */
+static int hsv_hdiv_table[256];
+
+/**
+ * @brief Fills in the reciprocal tables used by bgr_to_hsv_row.
+ */
+void init_hsv_tables(void) {
+  hsv_sdiv_table[0] = 0;
+  hsv_hdiv_table[0] = 0;
+  for (int i = 1; i < 256; i++) {
+    hsv_sdiv_table[i] = (int) lrint((255 << HSV_SHIFT) / (1.0 * i));
+    hsv_hdiv_table[i] = (int) lrint((180 << HSV_SHIFT) / (6.0 * i));
+  }
+}
+
+/**
+ * @brief Converts a row of BGR pixels to packed HSV.
+ * Uses the same integer arithmetic as cvCvtColor with CV_BGR2HSV, so the
+ * result is identical to converting the whole frame first.
+ * @param src The first BGR pixel of the row.
+ * @param dst Where to write the HSV pixels, 3 bytes each.
+ * @param width The number of pixels to convert.
+ * @param channels The number of bytes per source pixel.
+ */
+void bgr_to_hsv_row(const unsigned char *src, unsigned char *dst, int width, int channels) {
+  for (int x = 0; x < width; x++, src += channels, dst += 3) {
+    int b = src[0];
+    int g = src[1];
+    int r = src[2];
+    int v = b > g ? b : g;
+    v = v > r ? v : r;
+    int vmin = b < g ? b : g;
+    vmin = vmin < r ? vmin : r;
+    int diff = v - vmin;
+    int vr = v == r ? -1 : 0;
+    int vg = v == g ? -1 : 0;
+
+    int s = (diff * hsv_sdiv_table[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + (~vg & (r - g + 4 * diff))));
+    h = (h * hsv_hdiv_table[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    h += h < 0 ? 180 : 0;
+
+    dst[0] = (unsigned char) (h > 255 ? 255 : h);
+    dst[1] = (unsigned char) s;
+    dst[2] = (unsigned char) v;
+  }
+}
+
+/**
+ * @brief Picks the fastest threshold kernel the CPU supports.
+ * Should be called once at startup, get_arm calls it if it has not been.
+ */
+void init_threshold(void) {
+  init_hsv_tables();
+  threshold_row = threshold_row_scalar;
+#ifdef THRESHOLD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    threshold_row = threshold_row_avx2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    threshold_row = threshold_row_sse41;
+  }
+#endif
+}
+
 /**
  * @brief Gets a black and white frame of where the skin is.
  * Given a frame and a calibration struct, it marks each pixel white where skin
  * is present.
- * @param frame The IplImage frame.
+ * @param frame The HSV frame.
  * @param c The calibration which contains the skin colour.
- * @returns A black and white IplImage frame indicating where skin is.
- */
-IplImage *get_arm(IplImage *frame, calibration_t *c) {
-  IplImage *result = cvCreateImage(cvGetSize(frame), IPL_DEPTH_8U, 1);
-
-  for (int y = 0; y < frame->height; y++) {
-    for (int x = 0; x < frame->width; x++) {
-      if (in_range((unsigned char) frame->imageData[y * frame->widthStep + x * frame->nChannels], c->h_min, c->h_max, 180) &&
-          in_range((unsigned char) frame->imageData[y * frame->widthStep + x * frame->nChannels + 1], c->s_min, c->s_max, 255) &&
-          in_range((unsigned char) frame->imageData[y * frame->widthStep + x * frame->nChannels + 2], c->v_min, c->v_max, 255)) {
-        result->imageData[y * result->widthStep + x] = 255;
-      } else {
-        result->imageData[y * result->widthStep + x] = 0;
+ * @returns A black and white frame indicating where skin is.
+ */
+cv::Mat get_arm(const cv::Mat &frame, calibration_t *c) {
+  cv::Mat result(frame.rows, frame.cols, CV_8UC1);
+
+  channel_range_t ranges[3];
+  set_calibration_ranges(c, ranges);
+
+  if (!threshold_row) {
+    init_threshold();
+  }
+  // The vector kernels assume tightly packed 3 channel pixels.
+  threshold_row_function_t *row = frame.channels() == 3 ? threshold_row : threshold_row_scalar;
+
+  for (int y = 0; y < frame.rows; y++) {
+    row(frame.ptr<unsigned char>(y), result.ptr<unsigned char>(y), frame.cols, frame.channels(), ranges);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Fills in a calibration's skin lookup table.
+ * Each entry covers a cube of BGR colours, and is marked as skin if at least
+ * half of the colours in the cube pass the exact HSV test. Must be called
+ * whenever the calibration changes.
+ * @param c The calibration to build the table for.
+ */
+void build_skin_lut(calibration_t *c) {
+  const int shift = 8 - LUT_BITS;
+  unsigned char bgr[256 * 3];
+  unsigned char hsv[256 * 3];
+  unsigned char mask[256];
+
+  channel_range_t ranges[3];
+  set_calibration_ranges(c, ranges);
+
+  if (!threshold_row) {
+    init_threshold();
+  }
+
+  // The table doubles as the per cube skin count until it is thresholded.
+  memset(c->lut, 0, LUT_SIZE);
+  for (int b = 0; b < 256; b++) {
+    for (int g = 0; g < 256; g++) {
+      for (int r = 0; r < 256; r++) {
+        bgr[r * 3] = b;
+        bgr[r * 3 + 1] = g;
+        bgr[r * 3 + 2] = r;
+      }
+      bgr_to_hsv_row(bgr, hsv, 256, 3);
+      threshold_row(hsv, mask, 256, 3, ranges);
+
+      int base = ((b >> shift) << (2 * LUT_BITS)) | ((g >> shift) << LUT_BITS);
+      for (int r = 0; r < 256; r++) {
+        c->lut[base | (r >> shift)] += mask[r] & 1;
       }
     }
   }
 
+  int half = (1 << (3 * shift)) / 2;
+  for (int i = 0; i < LUT_SIZE; i++) {
+    c->lut[i] = c->lut[i] >= half ? 255 : 0;
+  }
+}
+
+/**
+ * @brief Classifies a row of BGR pixels with a skin lookup table.
+ * @param src The first BGR pixel of the row.
+ * @param dst The first mask byte of the row.
+ * @param width The number of pixels in the row.
+ * @param channels The number of bytes per pixel.
+ * @param lut The table built by build_skin_lut.
+ */
+void lut_row(const unsigned char *src, unsigned char *dst, int width, int channels, const unsigned char *lut) {
+  const int shift = 8 - LUT_BITS;
+  for (int x = 0; x < width; x++, src += channels) {
+    dst[x] = lut[((src[0] >> shift) << (2 * LUT_BITS)) | ((src[1] >> shift) << LUT_BITS) | (src[2] >> shift)];
+  }
+}
+
+/**
+ * @brief The arguments of threshold_band.
+ */
+typedef struct {
+  /** A view of the part of the BGR frame to threshold. */
+  cv::Mat src;
+  /** The calibration which contains the skin colour. */
+  calibration_t *c;
+  /** A view of the same part of the mask to write to. */
+  cv::Mat dst;
+  /** The HSV ranges of the calibration. */
+  channel_range_t ranges[3];
+  /** Pixels where the table and the exact test disagreed, per band. */
+  long mismatches[MAX_BANDS];
+} threshold_args_t;
+
+/**
+ * @brief Thresholds a band of rows of a region, see threshold_region.
+ */
+void threshold_band(int start, int end, int band, void *arg) {
+  threshold_args_t *a = (threshold_args_t *) arg;
+  int width = a->src.cols;
+  int channels = a->src.channels();
+  unsigned char hsv[HSV_CHUNK * 3];
+  unsigned char lut_mask[HSV_CHUNK];
+  long mismatches = 0;
+
+  for (int y = start; y < end; y++) {
+    const unsigned char *src = a->src.ptr<unsigned char>(y);
+    unsigned char *dst = a->dst.ptr<unsigned char>(y);
+
+    if (a->c->mode == threshold_lut) {
+      lut_row(src, dst, width, channels, a->c->lut);
+      continue;
+    }
+
+    for (int x = 0; x < width; x += HSV_CHUNK) {
+      int n = width - x < HSV_CHUNK ? width - x : HSV_CHUNK;
+      bgr_to_hsv_row(src + x * channels, hsv, n, channels);
+      threshold_row(hsv, dst + x, n, 3, a->ranges);
+
+      if (a->c->mode == threshold_compare) {
+        lut_row(src + x * channels, lut_mask, n, channels, a->c->lut);
+        for (int i = 0; i < n; i++) {
+          mismatches += lut_mask[i] != dst[x + i];
+        }
+      }
+    }
+  }
+
+  a->mismatches[band] = mismatches;
+}
+
+/**
+ * @brief Marks where the skin is in part of a BGR frame.
+ * In the exact mode the frame is converted to HSV a chunk of pixels at a time
+ * into a small buffer and thresholded straight away, so the frame itself is
+ * left untouched and is only read once. In the table mode each pixel is a
+ * single lookup instead. Both images are only read through views of the
+ * region, so nothing is copied. The rows are split into bands on the thread
+ * pool.
+ * @param frame The BGR frame.
+ * @param c The calibration which contains the skin colour.
+ * @param mask The black and white frame to write to, the same size as frame.
+ * @param region The part of the frame to threshold, must lie inside it.
+ */
+void threshold_region(const cv::Mat &frame, calibration_t *c, cv::Mat &mask, cv::Rect region) {
+  threshold_args_t a;
+  a.src = frame(region);
+  a.c = c;
+  a.dst = mask(region);
+  set_calibration_ranges(c, a.ranges);
+
+  if (!threshold_row) {
+    init_threshold();
+  }
+
+  int bands = band_count(region.height, MIN_BAND_ROWS);
+  run_bands(region.height, bands, threshold_band, &a);
+
+  if (c->mode == threshold_compare) {
+    for (int band = 0; band < bands; band++) {
+      c->lut_mismatches += a.mismatches[band];
+    }
+    c->lut_pixels += (long) region.width * region.height;
+  }
+}
+
+/**
+ * @brief Gets a black and white frame of where the skin is, from a BGR frame.
+ * @param frame The BGR frame.
+ * @param c The calibration which contains the skin colour.
+ * @returns A black and white frame indicating where skin is.
+ */
+cv::Mat get_arm_bgr(const cv::Mat &frame, calibration_t *c) {
+  cv::Mat result(frame.rows, frame.cols, CV_8UC1);
+  threshold_region(frame, c, result, cv::Rect(0, 0, frame.cols, frame.rows));
   return result;
 }
 
+/**
+ * @brief Prints how often the lookup table disagreed with the exact test.
+ * Only has anything to report in the compare mode.
+ * @param c The calibration used for thresholding.
+ */
+void print_lut_stats(calibration_t *c) {
+  if (c->mode == threshold_compare && c->lut_pixels > 0) {
+    printf("Lookup table disagreed on %ld of %ld pixels (%.3f%%).\n",
+           c->lut_mismatches, c->lut_pixels, 100.0 * c->lut_mismatches / c->lut_pixels);
+  }
+}
+
 /**
  * @brief Finds distance between 2 points in 3D space.
  * @param x1 The x coordinate of the first point.
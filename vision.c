@@ -0,0 +1,179 @@
+/**
+ * @file vision.c
+ * @brief The per frame pipeline from a webcam frame to the positions of the hands.
+ */
+
+#include <assert.h>
+
+/** How far past its window a hand may move in one frame and still be tracked, in tuned pixels. */
+#define ROI_MARGIN 40
+
+/**
+ * @brief A struct that holds the buffers and state of the vision pipeline.
+ */
+typedef struct {
+  /** Size of the processed frames relative to the webcam frames. */
+  double scale;
+  /** The webcam frame shrunk to the processing size, empty at scale 1. */
+  cv::Mat small;
+  /** The hands in processed frame coordinates. */
+  hands_t *tracked;
+  /** The tables detect_hands keeps between this pipeline's frames. */
+  detection_t *detection;
+  /** Radius of the majority filter at the processing size. */
+  int denoise_radius;
+  /** Where the skin is, only up to date inside the processed regions. */
+  cv::Mat skin;
+  /** The denoised skin that detect_hands reads, black outside the processed regions. */
+  cv::Mat mask;
+  /** Frames between full frame passes, 0 to always process the whole frame. */
+  int full_frame_interval;
+  /** Frames processed since the last full frame pass. */
+  int frames_since_full;
+  /** Frames processed so far. */
+  long frames;
+} vision_t;
+
+/**
+ * @brief Initialises the vision_t struct.
+ * The buffers are taken from the frame pool by prepare_vision, or on the
+ * first frame if it was not called.
+ * @param full_frame_interval Frames between full frame passes, 0 for every frame.
+ * @param scale Size of the processed frames relative to the webcam frames, at most 1.
+ * @returns A pointer to the new vision_t struct.
+ */
+vision_t *init_vision(int full_frame_interval, double scale) {
+  vision_t *v = new vision_t();
+  v->scale = scale;
+  v->tracked = init_hands();
+  v->tracked->scale = scale;
+  v->detection = init_detection();
+  v->denoise_radius = scale_distance(DENOISE_RADIUS, scale);
+  v->full_frame_interval = full_frame_interval;
+  v->frames_since_full = 0;
+  v->frames = 0;
+  return v;
+}
+
+/**
+ * @brief Takes the buffers for frames of a given size from the frame pool.
+ * @param v The vision pipeline.
+ * @param rows The height of the webcam frames.
+ * @param cols The width of the webcam frames.
+ * @param type The type of the webcam frames, such as CV_8UC3.
+ */
+void prepare_vision(vision_t *v, int rows, int cols, int type) {
+  if (v->scale != 1) {
+    rows *= v->scale;
+    cols *= v->scale;
+    v->small = acquire_mat(rows, cols, type);
+  }
+  v->skin = acquire_mat(rows, cols, CV_8UC1);
+  v->mask = acquire_mat(rows, cols, CV_8UC1);
+}
+
+/**
+ * @brief Frees the vision_t struct and its buffers.
+ * @param v The vision_t struct to free.
+ */
+void free_vision(vision_t *v) {
+  release_mat(&v->small);
+  free(v->tracked);
+  free_detection(v->detection);
+  release_mat(&v->skin);
+  release_mat(&v->mask);
+  delete v;
+}
+
+/**
+ * @brief Makes the square around a point, cut down to fit inside the frame.
+ * @param x The x position of the centre.
+ * @param y The y position of the centre.
+ * @param radius The distance from the centre to the edge of the square.
+ * @param width The width of the frame.
+ * @param height The height of the frame.
+ * @returns The part of the square inside the frame, may be empty.
+ */
+cv::Rect clip_square(int x, int y, int radius, int width, int height) {
+  int x0 = x - radius < 0 ? 0 : x - radius;
+  int y0 = y - radius < 0 ? 0 : y - radius;
+  int x1 = x + radius > width ? width : x + radius;
+  int y1 = y + radius > height ? height : y + radius;
+  return cv::Rect(x0, y0, x1 > x0 ? x1 - x0 : 0, y1 > y0 ? y1 - y0 : 0);
+}
+
+/**
+ * @brief Thresholds and denoises the part of the frame around one hand.
+ * The skin is found a denoise radius further out than the mask is written, so
+ * the mask inside the square is the same as from a full frame pass.
+ * @param v The vision pipeline.
+ * @param frame The BGR frame at the processing size.
+ * @param c The calibration which contains the skin colour.
+ * @param x The x position of the hand.
+ * @param y The y position of the hand.
+ * @param radius The distance from the hand to the edge of the square.
+ */
+void process_hand_region(vision_t *v, const cv::Mat &frame, calibration_t *c, int x, int y, int radius) {
+  cv::Rect inner = clip_square(x, y, radius, frame.cols, frame.rows);
+  if (inner.width == 0 || inner.height == 0) {
+    return;
+  }
+  cv::Rect outer = clip_square(x, y, radius + v->denoise_radius, frame.cols, frame.rows);
+  threshold_region(frame, c, v->skin, outer);
+  denoise_region(v->skin, v->mask, v->denoise_radius, inner);
+}
+
+/**
+ * @brief Finds the skin in a webcam frame and moves the hands to it.
+ * The frame is first shrunk to the processing scale, and the hands are
+ * tracked in that frame and then scaled back up to webcam coordinates.
+ * With a full frame interval only the squares detect_hands can reach from
+ * where the hands were are processed, and the rest of the mask is left black.
+ * The whole frame is still processed every full frame interval frames and
+ * whenever a hand had to be reset, so a lost hand can be found again.
+ * @param v The vision pipeline.
+ * @param webcam The BGR webcam frame.
+ * @param c The calibration which contains the skin colour.
+ * @param hands The last position of the hands, is updated to be the new position.
+ */
+void process_frame(vision_t *v, const cv::Mat &webcam, calibration_t *c, hands_t *hands) {
+  long allocations = frame_pool_allocations();
+  if (v->mask.empty()) {
+    prepare_vision(v, webcam.rows, webcam.cols, webcam.type());
+  }
+  if (v->scale != 1) {
+    // Writes straight into the pooled buffer, as it is already the right size.
+    cv::resize(webcam, v->small, v->small.size(), 0, 0, cv::INTER_AREA);
+  }
+  const cv::Mat &frame = v->scale != 1 ? v->small : webcam;
+
+  hands_t *tracked = v->tracked;
+  tracked->mode = hands->mode;
+  tracked->pyramid_levels = hands->pyramid_levels;
+  bool lost = reset_hands(tracked, frame.cols, frame.rows);
+
+  if (v->full_frame_interval == 0 || lost || v->frames_since_full >= v->full_frame_interval) {
+    cv::Rect all(0, 0, frame.cols, frame.rows);
+    threshold_region(frame, c, v->skin, all);
+    denoise_region(v->skin, v->mask, v->denoise_radius, all);
+    v->frames_since_full = 0;
+  } else {
+    int radius = hands_reach(tracked) + scale_distance(ROI_MARGIN, v->scale);
+    v->mask.setTo(cv::Scalar(0));
+    process_hand_region(v, frame, c, tracked->left_x, tracked->left_y, radius);
+    process_hand_region(v, frame, c, tracked->right_x, tracked->right_y, radius);
+    v->frames_since_full++;
+  }
+
+  detect_hands(v->detection, v->mask, tracked);
+
+  // Every image and band scratch a frame needs is taken from the pool on the first one, after that it is reused.
+  assert(v->frames == 0 || frame_pool_allocations() == allocations);
+  v->frames++;
+
+  hands->left_x = lrint(tracked->left_x / v->scale);
+  hands->left_y = lrint(tracked->left_y / v->scale);
+  hands->right_x = lrint(tracked->right_x / v->scale);
+  hands->right_y = lrint(tracked->right_y / v->scale);
+  hands->is_null = false;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file vision_benchmark.cpp
+ * @brief Times the banded vision stages on 1 up to one thread per core.
+ * The frames are generated, or replayed from a recording. A raw video is
+ * best, as its frames are read from a memory mapping without decoding, so
+ * only the vision stages are timed.
+ */
+
+#include <math.h>
+#include <time.h>
+#include "cv.h"
+#include "highgui.h"
+#include "uchar_array.c"
+#include "thread_pool.c"
+#include "frame_pool.c"
+#include "raw_video.c"
+#include "frame_source.c"
+#include "calibration.c"
+#include "threshold.c"
+#include "filter.c"
+#include "detection.c"
+#include "test_fixtures.c"
+
+/** Width of the benchmark frames, a 720p webcam. */
+#define BENCHMARK_WIDTH 1280
+/** Height of the benchmark frames. */
+#define BENCHMARK_HEIGHT 720
+/** Number of times each stage is run per thread count. */
+#define BENCHMARK_RUNS 50
+
+/**
+ * @brief Gets the time from a monotonic clock.
+ * @returns The time in seconds.
+ */
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Makes a frame of random colours, with a skin coloured disc for each hand.
+ */
+cv::Mat make_frame(void) {
+  cv::Mat frame = acquire_mat(BENCHMARK_HEIGHT, BENCHMARK_WIDTH, CV_8UC3);
+  srand(1);
+  for (int y = 0; y < frame.rows; y++) {
+    for (int x = 0; x < frame.cols; x++) {
+      unsigned char *p = frame.ptr<unsigned char>(y) + 3 * x;
+      bool is_skin = dist(x, y, 2 * BENCHMARK_WIDTH / 7, BENCHMARK_HEIGHT / 2) < 60
+        || dist(x, y, 5 * BENCHMARK_WIDTH / 7, BENCHMARK_HEIGHT / 2) < 60;
+      p[0] = is_skin ? 60 : rand() % 256;
+      p[1] = is_skin ? 100 : rand() % 256;
+      p[2] = is_skin ? 200 : rand() % 256;
+    }
+  }
+  return frame;
+}
+
+/**
+ * @brief Reads up to BENCHMARK_RUNS frames from a recording, before any timing starts.
+ * @param source The recording.
+ * @param frames Where to put the frames.
+ * @returns The number of frames read.
+ */
+int read_recording(frame_source_t *source, cv::Mat *frames) {
+  int count = 0;
+  cv::Mat frame;
+  while (count < BENCHMARK_RUNS && !(frame = read_frame(source)).empty()) {
+    // Stable frames are used straight from the mapping, others are only valid until the next read.
+    frames[count++] = source->stable ? frame : frame.clone();
+  }
+  if (count == 0) {
+    fprintf(stderr, "No frames to read\n");
+    exit(EXIT_FAILURE);
+  }
+  return count;
+}
+
+int main(int argc, char **argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+  frame_source_t *source = argc > 2 ? open_frame_source(argv[2], false) : NULL;
+
+  calibration_t *c = make_test_calibration();
+  init_threshold();
+
+  cv::Mat frames[BENCHMARK_RUNS];
+  int frame_count = source ? read_recording(source, frames) : 1;
+  if (!source) {
+    frames[0] = make_frame();
+  }
+  cv::Mat frame = frames[0];
+  cv::Mat skin = acquire_mat(frame.rows, frame.cols, CV_8UC1);
+  cv::Mat mask = acquire_mat(frame.rows, frame.cols, CV_8UC1);
+  cv::Mat overlay = acquire_mat(frame.rows, frame.cols, CV_8UC3);
+  frame.copyTo(overlay);
+  cv::Rect all(0, 0, frame.cols, frame.rows);
+  detection_t *detection = init_detection();
+
+  printf("%dx%d frames, %d different\n", frame.cols, frame.rows, frame_count);
+  printf("%7s %14s %14s %14s %14s\n", "threads", "threshold", "denoise", "overlay", "force");
+  double base[4];
+  int base_x = 0;
+  int base_y = 0;
+  for (int threads = 1; threads <= max_threads; threads++) {
+    init_thread_pool(threads);
+    double times[4];
+
+    double start = now();
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+      threshold_region(frames[i % frame_count], c, skin, all);
+    }
+    times[0] = now() - start;
+
+    start = now();
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+      denoise_region(skin, mask, DENOISE_RADIUS, all);
+    }
+    times[1] = now() - start;
+
+    start = now();
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+      overlay_frame(overlay, frame.cols / 2, frame.rows / 2, frame.rows / 4, frame.cols / 20);
+    }
+    times[2] = now() - start;
+
+    // A 720p frame is twice the size the force constants were tuned on.
+    int x = 0;
+    int y = 0;
+    start = now();
+    for (int i = 0; i < BENCHMARK_RUNS; i++) {
+      x = 2 * frame.cols / 7 + 40;
+      y = frame.rows / 2 - 40;
+      for (int j = 0; j < ITERATIONS; j++) {
+        apply_force_level(detection, mask, 0, 2, &x, &y, -1, 0.000005 * (ITERATIONS - j) / ITERATIONS);
+      }
+    }
+    times[3] = now() - start;
+
+    if (threads == 1) {
+      for (int s = 0; s < 4; s++) {
+        base[s] = times[s];
+      }
+      base_x = x;
+      base_y = y;
+    } else if (x != base_x || y != base_y) {
+      printf("Force result differs with %d threads!\n", threads);
+      return EXIT_FAILURE;
+    }
+
+    printf("%8d", threads);
+    for (int s = 0; s < 4; s++) {
+      printf(" %7.2fms x%.1f", 1000 * times[s] / BENCHMARK_RUNS, base[s] / times[s]);
+    }
+    printf("\n");
+    free_thread_pool();
+  }
+
+  if (source) {
+    close_frame_source(source);
+  } else {
+    release_mat(&frames[0]);
+  }
+  release_mat(&skin);
+  release_mat(&mask);
+  release_mat(&overlay);
+  free_detection(detection);
+  free_frame_pool();
+  free_calibration(c);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file vision_thread.c
+ * @brief Runs the vision pipeline on its own thread, so the game never waits for it.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include "debug_view.h"
+
+/**
+ * @brief The hands found in one webcam frame.
+ */
+typedef struct {
+  /** The positions of the hands, in webcam coordinates. */
+  hands_t hands;
+  /** The capture sequence number of the frame. */
+  uint64_t sequence;
+  /** CLOCK_MONOTONIC time the frame was grabbed, in seconds. */
+  double timestamp;
+  /** Width of the frame. */
+  int width;
+  /** Height of the frame. */
+  int height;
+} hands_sample_t;
+
+/**
+ * @brief A struct that holds the vision thread and what it publishes.
+ */
+typedef struct {
+  /** The vision pipeline, only used by the vision thread. */
+  vision_t *vision;
+  /** The skin colour calibration. */
+  calibration_t *c;
+  /** Where the frames come from. */
+  capture_thread_t *camera;
+  /** Where the calibration frames come from, before the capture thread starts. */
+  frame_source_t *source;
+  /** The hands being tracked, only used by the vision thread. */
+  hands_t hands;
+  /** The thread running the pipeline. */
+  pthread_t thread;
+  /** Set to make the vision thread exit. */
+  int stopping;
+  /** Seqlock counter for latest, odd while it is being written. */
+  unsigned int seq;
+  /** The newest result, read through the seqlock. */
+  hands_sample_t latest;
+  /** Guards the debug frames, only ever try-locked so neither thread waits. */
+  pthread_mutex_t debug_lock;
+  /** The latest frame with the hands drawn on, mirrored. */
+  cv::Mat debug_frame;
+  /** The latest skin mask. */
+  cv::Mat debug_mask;
+  /** True when the debug frames have not been shown yet. */
+  bool debug_fresh;
+  /** Where the debug windows are drawn. */
+  debug_view_mode_t debug_view;
+  /** The thread drawing the debug windows in the async mode. */
+  pthread_t debug_thread;
+  /** Capture time of the frame last copied for the debug view. */
+  double debug_time;
+  /** Set when q is pressed in a debug window drawn by the debug thread. */
+  int quit_requested;
+  /** An eventfd signalled whenever new hands are published. */
+  int ready_fd;
+  /** Set once the source has run out and its last frame has been tracked. */
+  int finished;
+} vision_thread_t;
+
+/**
+ * @brief Publishes a result through the seqlock.
+ * Only the vision thread writes, so the counter needs no compare and swap.
+ * @param t The vision thread.
+ * @param sample The result to publish.
+ */
+void publish_hands(vision_thread_t *t, const hands_sample_t *sample) {
+  unsigned int seq = t->seq;
+  __atomic_store_n(&t->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&t->latest, sample, sizeof(hands_sample_t));
+  __atomic_store_n(&t->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Reads the newest result without waiting for the vision thread.
+ * Retries only if the result was being written at the same moment.
+ * @param t The vision thread.
+ * @param sample Where to copy the result.
+ * @returns False if nothing has been published yet.
+ */
+bool read_hands(vision_thread_t *t, hands_sample_t *sample) {
+  unsigned int before;
+  unsigned int after;
+  do {
+    before = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+    memcpy(sample, &t->latest, sizeof(hands_sample_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+  } while ((before & 1) || before != after);
+  return before != 0;
+}
+
+/**
+ * @brief Copies a frame and its mask for the debug view, unless it is busy showing the last ones.
+ * In the async mode a snapshot is only taken if the last one is at least
+ * 1 / DEBUG_VIEW_HZ seconds old, so frames nobody will see are not copied.
+ * @param t The vision thread.
+ * @param frame The webcam frame.
+ * @param timestamp When the frame was grabbed.
+ */
+void update_debug_view(vision_thread_t *t, const cv::Mat &frame, double timestamp) {
+  if (t->debug_view == debug_view_async && timestamp - t->debug_time < 1.0 / DEBUG_VIEW_HZ) {
+    return;
+  }
+  if (pthread_mutex_trylock(&t->debug_lock)) {
+    return;
+  }
+  t->debug_time = timestamp;
+  frame.copyTo(t->debug_frame);
+  t->vision->mask.copyTo(t->debug_mask);
+  cv::Scalar red(255, 0, 0);
+  cv::circle(t->debug_frame, cv::Point(t->hands.left_x, t->hands.left_y), 10, red, 15);
+  cv::circle(t->debug_frame, cv::Point(t->hands.right_x, t->hands.right_y), 10, red, 15);
+  cv::flip(t->debug_frame, t->debug_frame, 1);
+  t->debug_fresh = true;
+  pthread_mutex_unlock(&t->debug_lock);
+}
+
+/**
+ * @brief Shows the newest debug frames, if there are new ones and the vision thread is not writing them.
+ * Must be called from the thread that owns the windows.
+ * @param t The vision thread.
+ */
+void show_debug_view(vision_thread_t *t) {
+  if (pthread_mutex_trylock(&t->debug_lock)) {
+    return;
+  }
+  if (t->debug_fresh) {
+    cv::imshow("Arm Detection", t->debug_frame);
+    cv::imshow("BW Matte", t->debug_mask);
+    t->debug_fresh = false;
+  }
+  pthread_mutex_unlock(&t->debug_lock);
+}
+
+/**
+ * @brief The loop the debug thread runs in the async mode.
+ * The calibration window and the debug windows are all made, drawn and
+ * closed on this thread, so HighGUI is only ever used from one thread.
+ * Waiting for keys between updates caps the rate and keeps the windows
+ * responsive.
+ * @param data The vision_thread_t struct.
+ * @returns NULL once stopped.
+ */
+void *debug_view_loop(void *data) {
+  vision_thread_t *t = (vision_thread_t *) data;
+  calibrate(t->source, t->c);
+  // Nothing waits on ready_fd until the vision thread starts, so it also says calibration is done.
+  notify(t->ready_fd);
+
+  cvNamedWindow("Arm Detection", 1);
+  cvNamedWindow("BW Matte", 1);
+
+  while (!__atomic_load_n(&t->stopping, __ATOMIC_ACQUIRE)) {
+    show_debug_view(t);
+    if (cvWaitKey(1000 / DEBUG_VIEW_HZ) == 'q') {
+      __atomic_store_n(&t->quit_requested, 1, __ATOMIC_RELEASE);
+      // Wake the game loop so it sees the request.
+      notify(t->ready_fd);
+    }
+  }
+
+  cvDestroyWindow("Arm Detection");
+  cvDestroyWindow("BW Matte");
+  return NULL;
+}
+
+/**
+ * @brief Keeps the debug view drawn, from the game loop.
+ * In the inline mode the newest frames are shown and HighGUI is given a
+ * moment to draw them, so it should be called each time new hands are
+ * published. Otherwise it only checks whether the debug thread saw q.
+ * @param t The vision thread.
+ * @returns True iff q was pressed in a debug window.
+ */
+bool pump_debug_view(vision_thread_t *t) {
+  if (t->debug_view == debug_view_inline) {
+    show_debug_view(t);
+    return cvWaitKey(1) == 'q';
+  }
+  return __atomic_load_n(&t->quit_requested, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Checks whether every frame from the source has been tracked.
+ * Only recorded sources ever finish.
+ * @param t The vision thread.
+ * @returns True iff no more hands will be published.
+ */
+bool tracking_finished(vision_thread_t *t) {
+  return __atomic_load_n(&t->finished, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief The loop the vision thread runs, processing each new frame.
+ * @param data The vision_thread_t struct.
+ * @returns NULL once stopped.
+ */
+void *vision_loop(void *data) {
+  vision_thread_t *t = (vision_thread_t *) data;
+
+  while (!__atomic_load_n(&t->stopping, __ATOMIC_ACQUIRE)) {
+    // Checked first, so a frame put in the mailbox just before the end is not missed.
+    bool done = capture_finished(t->camera);
+    captured_frame_t *frame = latest_frame(t->camera);
+    if (!frame && done) {
+      __atomic_store_n(&t->finished, 1, __ATOMIC_RELEASE);
+      notify(t->ready_fd);
+      break;
+    }
+    if (!frame) {
+      wait_for_frame(t->camera);
+      continue;
+    }
+
+    process_frame(t->vision, frame->image, t->c, &t->hands);
+
+    hands_sample_t sample;
+    sample.hands = t->hands;
+    sample.sequence = frame->sequence;
+    sample.timestamp = frame->timestamp;
+    sample.width = frame->image.cols;
+    sample.height = frame->image.rows;
+    publish_hands(t, &sample);
+    notify(t->ready_fd);
+
+    if (t->debug_view != debug_view_none) {
+      update_debug_view(t, frame->image, frame->timestamp);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Initialises the vision_thread_t struct and calibrates the skin colour.
+ * Calibration runs on whichever thread draws the debug windows: the generic
+ * calibration without them, the calibration window on this thread in the
+ * inline mode, or on the debug thread, started here, in the async mode.
+ * Returns once calibration is done.
+ * @param c The skin colour calibration to fill in.
+ * @param source Where the calibration frames come from.
+ * @param debug_view Where to draw the debug windows. In the inline mode
+ *        they are drawn by this thread, so it must be the game loop's.
+ * @returns A pointer to the new vision_thread_t struct.
+ */
+vision_thread_t *init_vision_thread(calibration_t *c, frame_source_t *source, debug_view_mode_t debug_view) {
+  vision_thread_t *t = new vision_thread_t();
+  t->c = c;
+  t->source = source;
+  t->stopping = 0;
+  t->seq = 0;
+  pthread_mutex_init(&t->debug_lock, NULL);
+  t->debug_fresh = false;
+  t->debug_view = debug_view;
+  t->debug_time = 0;
+  t->quit_requested = 0;
+  t->ready_fd = make_notifier();
+  t->finished = 0;
+
+  if (debug_view == debug_view_none) {
+    generic_calibration(c);
+  } else if (debug_view == debug_view_inline) {
+    calibrate(source, c);
+  } else {
+    if (pthread_create(&t->debug_thread, NULL, debug_view_loop, t)) {
+      perror("Unable to start debug view thread");
+      exit(EXIT_FAILURE);
+    }
+    wait_notifier(t->ready_fd);
+  }
+  return t;
+}
+
+/**
+ * @brief Starts the thread tracking the hands in frames from a capture thread.
+ * @param t The vision thread, from init_vision_thread.
+ * @param vision The vision pipeline to run.
+ * @param camera Where the frames come from, only the vision thread may take them.
+ * @param hands The starting hands, whose detection settings are used.
+ */
+void start_vision_thread(vision_thread_t *t, vision_t *vision, capture_thread_t *camera, hands_t *hands) {
+  t->vision = vision;
+  t->camera = camera;
+  t->hands = *hands;
+  debug_view_mode_t debug_view = t->debug_view;
+
+  const cv::Mat &image = camera->slots[0].image;
+  prepare_vision(vision, image.rows, image.cols, image.type());
+  if (debug_view != debug_view_none) {
+    // The debug thread may already be running, so the frames are set up under its lock.
+    pthread_mutex_lock(&t->debug_lock);
+    t->debug_frame = acquire_mat(image.rows, image.cols, image.type());
+    t->debug_mask = acquire_mat(vision->mask.rows, vision->mask.cols, CV_8UC1);
+    pthread_mutex_unlock(&t->debug_lock);
+  }
+
+  if (debug_view == debug_view_inline) {
+    cvNamedWindow("Arm Detection", 1);
+    cvNamedWindow("BW Matte", 1);
+  }
+
+  if (pthread_create(&t->thread, NULL, vision_loop, t)) {
+    perror("Unable to start vision thread");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief Stops the vision thread, closes the debug windows and gives the debug frames back to the frame pool.
+ * The vision pipeline, calibration and camera are left for the caller to free.
+ * @param t The vision thread.
+ */
+void stop_vision_thread(vision_thread_t *t) {
+  __atomic_store_n(&t->stopping, 1, __ATOMIC_RELEASE);
+  // Wake the thread if it is waiting for a frame.
+  notify(t->camera->ready_fd);
+  pthread_join(t->thread, NULL);
+  if (t->debug_view == debug_view_async) {
+    pthread_join(t->debug_thread, NULL);
+  } else if (t->debug_view == debug_view_inline) {
+    cvDestroyWindow("Arm Detection");
+    cvDestroyWindow("BW Matte");
+  }
+  pthread_mutex_destroy(&t->debug_lock);
+  close(t->ready_fd);
+  release_mat(&t->debug_frame);
+  release_mat(&t->debug_mask);
+  delete t;
+}